@@ -0,0 +1,61 @@
+#ifndef _DATA_DEVICE_H_
+#define _DATA_DEVICE_H_
+
+/*
+ioctls of /dev/rxdata & /dev/lockdata, shared by the kernel module and userspace.
+
+Their sizes are the rxdata_bytes & lockdata_bytes module parameters (4MB by default), which userspace
+reads from /sys/module/modcameleon/parameters to map the whole memory.
+
+When the module is loaded with cached_data=1, the acquisition memory is cacheable and mapped for
+streaming DMA: the part of a mapping about to be read must be synced for the CPU once the FPGA
+has written it, then synced back for the device before the FPGA writes it again.
+read() syncs by itself, and the ioctls do nothing on the default coherent memory.
+
+/dev/rxdata can also keep a ring of snapshot_depth (module parameter) copies of the acquisition halves,
+made by the module as soon as the FPGA is done with a half, so the halves are not lost when userspace
+is late. The ring is set up for halves of a size, then each ACQUISITION_(HALF_)FULL interrupt has its
+snapshot, taken in order. The interrupt is published before the copy is done, taking waits for it.
+*/
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdint.h>
+#include <sys/ioctl.h>
+#endif
+
+typedef struct {
+	uint32_t offset;	//bytes from the start of the memory
+	uint32_t nbytes;
+} data_range_t;
+
+typedef struct {
+	uint64_t buffer;	//userspace address the snapshot is copied to
+	uint32_t nbytes;	//of the buffer
+	uint32_t offset;	//out: of the half the snapshot was taken from
+	uint32_t queued;	//out: snapshots left in the ring
+	uint32_t overruns;	//out: halves lost since the setup, the ring being full
+} data_snapshot_t;
+
+typedef struct {
+	uint32_t depth;		//0 when the ring is disabled
+	uint32_t slot_bytes;
+	uint32_t queued;
+	uint32_t high_water;	//most snapshots queued at once since the setup
+	uint32_t overruns;
+	uint32_t taken;
+} data_snapshot_status_t;
+
+#define DATA_IOCTL_MAGIC				'c'
+#define DATA_IOCTL_SYNC_FOR_CPU			_IOW(DATA_IOCTL_MAGIC, 1, data_range_t)
+#define DATA_IOCTL_SYNC_FOR_DEVICE		_IOW(DATA_IOCTL_MAGIC, 2, data_range_t)
+//rxdata only. Sets the ring up for halves of nbytes, 0 to disable it, returns its depth
+#define DATA_IOCTL_SNAPSHOT_SETUP		_IOW(DATA_IOCTL_MAGIC, 3, uint32_t)
+//copies the oldest snapshot to the buffer and frees it, returns the bytes copied.
+//Waits for it up to 1s, fails with ENODATA if the ring was reset meanwhile
+#define DATA_IOCTL_SNAPSHOT_TAKE		_IOWR(DATA_IOCTL_MAGIC, 4, data_snapshot_t)
+#define DATA_IOCTL_SNAPSHOT_STATUS		_IOR(DATA_IOCTL_MAGIC, 5, data_snapshot_status_t)
+
+#endif
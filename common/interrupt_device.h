@@ -0,0 +1,32 @@
+#ifndef _INTERRUPT_DEVICE_H_
+#define _INTERRUPT_DEVICE_H_
+
+/*
+Record mode of /dev/interrupts, shared by the kernel module and userspace.
+
+By default each read() returns a single interrupt code byte. Once switched to record mode, a read()
+returns as many pending interrupts as whole records fit in its buffer, each with the time the module
+queued it, so a burst is drained in one call. A read stops after an ACQUISITION_(HALF_)FULL though,
+so the module still sees a next data interrupt arriving before it is handled. The mode is back to bytes
+on each open.
+*/
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdint.h>
+#include <sys/ioctl.h>
+#endif
+
+typedef struct {
+	uint64_t time_ns;	//CLOCK_MONOTONIC, when the interrupt was queued by the module
+	uint8_t code;		//see interrupt_codes.h
+	uint8_t reserved[7];
+} interrupt_record_t;
+
+#define INTERRUPTS_IOCTL_MAGIC			'i'
+//1 for record mode, 0 for single bytes
+#define INTERRUPTS_IOCTL_RECORDS		_IOW(INTERRUPTS_IOCTL_MAGIC, 1, uint32_t)
+
+#endif
@@ -1,21 +1,41 @@
+#include "../common/data_device.h"
 #include "dev_data.h"
 #include "dynamic_device.h"
 #include "config.h"
 #include "klog.h"
 
-#define MAX_RXDATA_BYTES 4194304
 #define RXDATA_ADDR_REG 0xff20ffd8
-
-#define MAX_LOCKDATA_BYTES 4194304
 #define LOCKDATA_ADDR_REG 0xff20ffd4
 
+//the FPGA is given the address of a single block, which its two halves must fit in
+#define DEFAULT_DATA_BYTES 4194304
+#define MIN_DATA_BYTES (2 * PAGE_SIZE)
+//alloc_pages_exact takes a single block of the page allocator, cached_data memory cannot be larger
+#define MAX_CACHED_DATA_BYTES (MAX_ORDER_NR_PAGES * PAGE_SIZE)
+//the FPGA address registers are 32 bits wide
+#define MAX_FPGA_ADDR 0xFFFFFFFFULL
+
 typedef struct {
 	dynamic_device_t* owner;
+	struct device* dma_device;	//for the DMA API, owner->device as it was when reserving, before registration
+	bool streaming;			//cacheable pages mapped for streaming DMA, instead of coherent memory
 	size_t size;
 	void* addr_virtual;
 	dma_addr_t addr_dma;
 } reserved_memory_t;
 
+static bool cached_data = false;
+module_param(cached_data, bool, 0444);
+MODULE_PARM_DESC(cached_data, "Cacheable acquisition memory, synced for each block read, instead of uncached coherent memory");
+
+static uint rxdata_bytes = DEFAULT_DATA_BYTES;
+module_param(rxdata_bytes, uint, 0444);
+MODULE_PARM_DESC(rxdata_bytes, "Size of the acquisition memory in whole pages, at most one page allocator block with cached_data, else the CMA area (default 4MB)");
+
+static uint lockdata_bytes = DEFAULT_DATA_BYTES;
+module_param(lockdata_bytes, uint, 0444);
+MODULE_PARM_DESC(lockdata_bytes, "Size of the lock memory in whole pages, at most one page allocator block with cached_data, else the CMA area (default 4MB)");
+
 static dynamic_device_t rxdata_device;
 static reserved_memory_t rxdata_mem;
 
@@ -24,21 +44,69 @@ static reserved_memory_t lockdata_mem;
 
 //-- memory management
 
-static bool reserve_memory(dynamic_device_t* owner, size_t nbytes, reserved_memory_t* memory) {
+//cacheable pages, owned by the device until synced for the cpu
+static bool reserve_streaming_memory(reserved_memory_t* memory) {
+	memory->addr_virtual = alloc_pages_exact(memory->size, GFP_KERNEL | __GFP_ZERO);
+	if (memory->addr_virtual == NULL) {
+		klog_error("alloc_pages_exact failed\n");
+		return false;
+	}
+
+	memory->addr_dma = dma_map_single(memory->dma_device, memory->addr_virtual, memory->size, DMA_FROM_DEVICE);
+	if (dma_mapping_error(memory->dma_device, memory->addr_dma)) {
+		klog_error("dma_map_single failed\n");
+		free_pages_exact(memory->addr_virtual, memory->size);
+		memory->addr_virtual = NULL;
+		return false;
+	}
+	return true;
+}
+
+//the size parameters are read-only, checked once when creating the devices;
+//coherent memory comes from the CMA area, whose size is only known by reserve_memory
+static bool valid_memory_size(const char* param, uint nbytes) {
+	if (nbytes < MIN_DATA_BYTES || nbytes % PAGE_SIZE != 0) {
+		klog_error("Invalid %s=%u: whole pages of %lu bytes, at least %lu bytes\n", param, nbytes, (ulong)PAGE_SIZE, (ulong)MIN_DATA_BYTES);
+		return false;
+	}
+
+	if (cached_data && nbytes > MAX_CACHED_DATA_BYTES) {
+		klog_error("Invalid %s=%u: with cached_data=1, at most %lu bytes, the largest block of the page allocator\n", param, nbytes,
+			(ulong)MAX_CACHED_DATA_BYTES);
+		return false;
+	}
+	return true;
+}
+
+static bool reserve_memory(const char* param, dynamic_device_t* owner, size_t nbytes, reserved_memory_t* memory) {
 	//allocate free memory, reserve it
 	memory->owner = owner;
+	memory->dma_device = owner->device;
+	memory->streaming = cached_data;
 	memory->size = nbytes;
-	memory->addr_virtual = dma_alloc_coherent(owner->device, nbytes, &memory->addr_dma, GFP_KERNEL);
-	if (memory->addr_virtual == NULL) {
-		klog_error("dma_alloc_coherent failed");
-		return false;
+	if (memory->streaming) {
+		if (!reserve_streaming_memory(memory)) {
+			return false;
+		}
+	}
+	else {
+		memory->addr_virtual = dma_alloc_coherent(memory->dma_device, nbytes, &memory->addr_dma, GFP_KERNEL);
+		if (memory->addr_virtual == NULL) {
+			klog_error("dma_alloc_coherent of %s=%zu failed, the CMA area is too small (cma= kernel parameter)\n", param, nbytes);
+			return false;
+		}
 	}
 	
-	klog_info("reserved memory: virtual=0x%p, dma=0x%lx", memory->addr_virtual, (ulong)memory->addr_dma);
+	klog_info("reserved %zu bytes of %s memory: virtual=0x%p, dma=0x%lx", nbytes, memory->streaming ? "cached" : "coherent", memory->addr_virtual, (ulong)memory->addr_dma);
 	return true;
 }
 
 static bool write_address_to_fpga(phys_addr_t register_addr, reserved_memory_t* memory) {
+	if ((u64)memory->addr_dma + memory->size - 1 > MAX_FPGA_ADDR) {
+		klog_error("Memory at dma=0x%llx is out of reach of the 32 bits FPGA address register\n", (u64)memory->addr_dma);
+		return false;
+	}
+
 	void* ptr = ioremap(register_addr, 4);
 	if (ptr == 0) {
 		klog_error("Error while remapping register_addr (0x%x)\n", register_addr);
@@ -51,7 +119,27 @@ static bool write_address_to_fpga(phys_addr_t register_addr, reserved_memory_t*
 }
 
 static void free_memory(reserved_memory_t* memory) {
-	dma_free_coherent(memory->owner->device, memory->size, memory->addr_virtual, memory->addr_dma);
+	if (memory->streaming) {
+		dma_unmap_single(memory->dma_device, memory->addr_dma, memory->size, DMA_FROM_DEVICE);
+		free_pages_exact(memory->addr_virtual, memory->size);
+	}
+	else {
+		dma_free_coherent(memory->dma_device, memory->size, memory->addr_virtual, memory->addr_dma);
+	}
+}
+
+//gives a range of streaming memory to the cpu, so it reads what the FPGA wrote, or back to the FPGA
+static void sync_memory(reserved_memory_t* memory, size_t offset, size_t nbytes, bool for_cpu) {
+	if (!memory->streaming) {
+		return;
+	}
+
+	if (for_cpu) {
+		dma_sync_single_range_for_cpu(memory->dma_device, memory->addr_dma, offset, nbytes, DMA_FROM_DEVICE);
+	}
+	else {
+		dma_sync_single_range_for_device(memory->dma_device, memory->addr_dma, offset, nbytes, DMA_FROM_DEVICE);
+	}
 }
 
 //-- specific open functions, sets private data
@@ -105,15 +193,293 @@ static ssize_t dev_anydata_read(struct file *filp, char __user *user_buffer, siz
 	}
 
 	void* ptr = ((void*)mem->addr_virtual) + *offset;
+	sync_memory(mem, *offset, nbytes, true);
 	if (copy_to_user(user_buffer, ptr, nbytes)) {
 		klog_error("Unable to copy from address 0x%p to userspace!\n", ptr);
 		return -EFAULT;
 	}
+	sync_memory(mem, *offset, nbytes, false);
 		
 	*offset += nbytes;
 	return nbytes;
 }
 
+//-- snapshot ring of the acquisition halves, see data_device.h
+
+#define SNAPSHOT_MAX_DEPTH 32
+
+static uint snapshot_depth = 8;
+module_param(snapshot_depth, uint, 0444);
+MODULE_PARM_DESC(snapshot_depth, "Snapshots of the acquisition halves kept for userspace, 0 to disable the ring (default: 8, at most " STR(SNAPSHOT_MAX_DEPTH) ")");
+
+typedef enum {
+	SLOT_FREE,
+	SLOT_COPYING,		//the half is being copied
+	SLOT_READY,			//until it is taken
+} slot_state_t;
+
+typedef struct {
+	void* slots;		//depth slots of slot_bytes
+	uint32_t depth;
+	uint32_t slot_bytes;	//0 when the ring is disabled
+	slot_state_t states[SNAPSHOT_MAX_DEPTH];
+	uint32_t offsets[SNAPSHOT_MAX_DEPTH];	//of the half copied in each slot
+	uint32_t next_write;
+	uint32_t next_copy;
+	uint32_t next_read;
+	data_snapshot_status_t status;
+	struct work_struct work;
+	wait_queue_head_t ready;
+} snapshot_ring_t;
+
+static snapshot_ring_t ring;
+//the interrupt handler queues the snapshots, no mutex
+static DEFINE_SPINLOCK(ring_lock);
+//serializes the setups, resets and takes. A take waits for its snapshot without it
+static DEFINE_MUTEX(ring_mutex);
+
+static void copy_snapshots(struct work_struct* work) {
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	while (ring.slot_bytes != 0 && ring.states[ring.next_copy] == SLOT_COPYING) {
+		uint32_t slot = ring.next_copy;
+		uint32_t offset = ring.offsets[slot];
+		uint32_t nbytes = ring.slot_bytes;
+		spin_unlock_irqrestore(&ring_lock, flags);
+
+		//the FPGA is filling the other half meanwhile. The slots only change once stop_ring() waited for this work
+		sync_memory(&rxdata_mem, offset, nbytes, true);
+		memcpy(ring.slots + (size_t)slot * nbytes, rxdata_mem.addr_virtual + offset, nbytes);
+		sync_memory(&rxdata_mem, offset, nbytes, false);
+
+		spin_lock_irqsave(&ring_lock, flags);
+		ring.states[slot] = SLOT_READY;
+		ring.next_copy = (slot + 1) % ring.depth;
+	}
+	spin_unlock_irqrestore(&ring_lock, flags);
+	wake_up_interruptible(&ring.ready);
+}
+
+//disables the ring and waits for the copy in progress, the slots can then be changed
+static uint32_t stop_ring(void) {
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	uint32_t slot_bytes = ring.slot_bytes;
+	ring.slot_bytes = 0;
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	cancel_work_sync(&ring.work);
+	wake_up_interruptible(&ring.ready);
+	return slot_bytes;
+}
+
+static void start_ring(uint32_t slot_bytes) {
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	memset(ring.states, 0, sizeof(ring.states));
+	ring.next_write = 0;
+	ring.next_copy = 0;
+	ring.next_read = 0;
+	memset(&ring.status, 0, sizeof(ring.status));
+	ring.status.depth = slot_bytes != 0 ? ring.depth : 0;
+	ring.status.slot_bytes = slot_bytes;
+	ring.slot_bytes = slot_bytes;
+	spin_unlock_irqrestore(&ring_lock, flags);
+}
+
+static long snapshot_setup(uint32_t nbytes) {
+	uint32_t depth = min_t(uint32_t, snapshot_depth, SNAPSHOT_MAX_DEPTH);
+	if (nbytes > rxdata_mem.size / 2) {
+		klog_error("Unable to keep snapshots of %u bytes, memory is %zu bytes\n", nbytes, rxdata_mem.size);
+		return -EINVAL;
+	}
+
+	stop_ring();
+	vfree(ring.slots);
+	ring.slots = NULL;
+	ring.depth = 0;
+	if (nbytes == 0 || depth == 0) {
+		start_ring(0);
+		return 0;
+	}
+
+	ring.slots = vmalloc((size_t)depth * nbytes);
+	if (ring.slots == NULL) {
+		klog_error("Unable to allocate %u snapshots of %u bytes\n", depth, nbytes);
+		start_ring(0);
+		return -ENOMEM;
+	}
+	ring.depth = depth;
+	start_ring(nbytes);
+	klog_info("snapshot ring of %u halves of %u bytes\n", depth, nbytes);
+	return depth;
+}
+
+static bool snapshot_ready(void) {
+	return ring.slot_bytes == 0 || ring.states[ring.next_read] == SLOT_READY;
+}
+
+static long snapshot_take(data_snapshot_t __user* user_snapshot) {
+	data_snapshot_t snapshot;
+	if (copy_from_user(&snapshot, user_snapshot, sizeof(snapshot))) {
+		return -EFAULT;
+	}
+
+	//the interrupt is published as the copy starts, it is done well before the FPGA fills the next half.
+	//Waiting without the mutex, so that a reset or a setup is not held up, the ring is checked again once locked
+	long remaining = wait_event_interruptible_timeout(ring.ready, snapshot_ready(), HZ);
+	if (remaining < 0) {
+		return remaining;
+	}
+
+	mutex_lock(&ring_mutex);
+	if (ring.slot_bytes == 0) {
+		mutex_unlock(&ring_mutex);
+		return -ENODEV;
+	}
+	uint32_t slot = ring.next_read;
+	if (ring.states[slot] != SLOT_READY) {
+		//reset while waiting, the snapshot waited for is gone
+		if (remaining == 0) {
+			klog_error("No snapshot ready after 1s, %u queued\n", ring.status.queued);
+		}
+		mutex_unlock(&ring_mutex);
+		return remaining == 0 ? -ETIMEDOUT : -ENODATA;
+	}
+
+	uint32_t nbytes = min(snapshot.nbytes, ring.slot_bytes);
+	long result = nbytes;
+	if (copy_to_user((void __user*)(uintptr_t)snapshot.buffer, ring.slots + (size_t)slot * ring.slot_bytes, nbytes)) {
+		klog_error("Unable to copy snapshot %u to userspace!\n", slot);
+		result = -EFAULT;
+	}
+
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	ring.states[slot] = SLOT_FREE;
+	ring.next_read = (slot + 1) % ring.depth;
+	ring.status.queued--;
+	ring.status.taken++;
+	snapshot.offset = ring.offsets[slot];
+	snapshot.queued = ring.status.queued;
+	snapshot.overruns = ring.status.overruns;
+	spin_unlock_irqrestore(&ring_lock, flags);
+	mutex_unlock(&ring_mutex);
+
+	if (copy_to_user(user_snapshot, &snapshot, sizeof(snapshot))) {
+		return -EFAULT;
+	}
+	return result;
+}
+
+static long snapshot_status(data_snapshot_status_t __user* user_status) {
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	data_snapshot_status_t status = ring.status;
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	if (copy_to_user(user_status, &status, sizeof(status))) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+int dev_rxdata_snapshot(bool second_half) {
+	unsigned long flags;
+	spin_lock_irqsave(&ring_lock, flags);
+	if (ring.slot_bytes == 0) {
+		spin_unlock_irqrestore(&ring_lock, flags);
+		return -ENODEV;
+	}
+	if (ring.status.queued == ring.depth) {
+		ring.status.overruns++;
+		spin_unlock_irqrestore(&ring_lock, flags);
+		klog_error("Snapshot ring full, %u halves queued\n", ring.depth);
+		return -EOVERFLOW;
+	}
+
+	uint32_t slot = ring.next_write;
+	ring.offsets[slot] = second_half ? ring.slot_bytes : 0;
+	ring.states[slot] = SLOT_COPYING;
+	ring.next_write = (slot + 1) % ring.depth;
+	ring.status.queued++;
+	ring.status.high_water = max(ring.status.high_water, ring.status.queued);
+	spin_unlock_irqrestore(&ring_lock, flags);
+
+	queue_work(system_highpri_wq, &ring.work);
+	return 0;
+}
+
+void dev_rxdata_snapshot_reset(void) {
+	mutex_lock(&ring_mutex);
+	start_ring(stop_ring());
+	mutex_unlock(&ring_mutex);
+}
+
+//syncs a range of a mapping, or manages the snapshot ring, see data_device.h
+static long dev_anydata_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+	reserved_memory_t* mem = (reserved_memory_t*)filp->private_data;
+	if (mem == &rxdata_mem && cmd == DATA_IOCTL_SNAPSHOT_TAKE) {
+		//locks the ring itself once a snapshot is ready
+		return snapshot_take((data_snapshot_t __user*)arg);
+	}
+	if (mem == &rxdata_mem && (cmd == DATA_IOCTL_SNAPSHOT_SETUP || cmd == DATA_IOCTL_SNAPSHOT_STATUS)) {
+		uint32_t nbytes;
+		long result = -EFAULT;
+		mutex_lock(&ring_mutex);
+		if (cmd == DATA_IOCTL_SNAPSHOT_STATUS) {
+			result = snapshot_status((data_snapshot_status_t __user*)arg);
+		}
+		else if (!copy_from_user(&nbytes, (void __user*)arg, sizeof(nbytes))) {
+			result = snapshot_setup(nbytes);
+		}
+		mutex_unlock(&ring_mutex);
+		return result;
+	}
+	if (cmd != DATA_IOCTL_SYNC_FOR_CPU && cmd != DATA_IOCTL_SYNC_FOR_DEVICE) {
+		return -ENOTTY;
+	}
+
+	data_range_t range;
+	if (copy_from_user(&range, (void __user*)arg, sizeof(range))) {
+		return -EFAULT;
+	}
+	if (range.offset >= mem->size || range.nbytes > mem->size - range.offset) {
+		klog_error("Unable to sync %u bytes at offset %u, memory is %zu bytes\n", range.nbytes, range.offset, mem->size);
+		return -EINVAL;
+	}
+
+	sync_memory(mem, range.offset, range.nbytes, cmd == DATA_IOCTL_SYNC_FOR_CPU);
+	return 0;
+}
+
+//maps the memory, or a part of it, so userspace can copy the data without going through read()
+static int dev_anydata_mmap(struct file *filp, struct vm_area_struct *vma) {
+	reserved_memory_t* mem = (reserved_memory_t*)filp->private_data;
+	size_t nbytes = vma->vm_end - vma->vm_start;
+	size_t offset = vma->vm_pgoff << PAGE_SHIFT;
+
+	if (offset >= mem->size || nbytes > mem->size - offset) {
+		klog_error("Unable to map %zu bytes at offset %zu, memory is %zu bytes\n", nbytes, offset, mem->size);
+		return -EINVAL;
+	}
+
+	//streaming memory is mapped cacheable, to be synced with the ioctls.
+	//dma_mmap_coherent() maps from vm_pgoff, uncached as the kernel mapping
+	int err;
+	if (mem->streaming) {
+		ulong pfn = (virt_to_phys(mem->addr_virtual) >> PAGE_SHIFT) + vma->vm_pgoff;
+		err = remap_pfn_range(vma, vma->vm_start, pfn, nbytes, vma->vm_page_prot);
+	}
+	else {
+		err = dma_mmap_coherent(mem->dma_device, vma, mem->addr_virtual, mem->addr_dma, mem->size);
+	}
+	if (err) {
+		klog_error("Error %d while mapping %zu bytes at offset %zu\n", err, nbytes, offset);
+	}
+	return err;
+}
+
 //-- public functions, create & destroy devices
 
 static struct file_operations rxdata_fops = {
@@ -122,10 +488,19 @@ static struct file_operations rxdata_fops = {
 	.release = dev_anydata_release,
 	.llseek = dev_anydata_llseek,
 	.read = dev_anydata_read,
+	.unlocked_ioctl = dev_anydata_ioctl,
+	.mmap = dev_anydata_mmap,
 };
 
 bool dev_rxdata_create(void) {
-	if (!reserve_memory(&rxdata_device, MAX_RXDATA_BYTES, &rxdata_mem) || !write_address_to_fpga(RXDATA_ADDR_REG, &rxdata_mem)) {
+	INIT_WORK(&ring.work, copy_snapshots);
+	init_waitqueue_head(&ring.ready);
+
+	if (!valid_memory_size("rxdata_bytes", rxdata_bytes)) {
+		return false;
+	}
+
+	if (!reserve_memory("rxdata_bytes", &rxdata_device, rxdata_bytes, &rxdata_mem) || !write_address_to_fpga(RXDATA_ADDR_REG, &rxdata_mem)) {
 		return false;
 	}
 
@@ -138,6 +513,8 @@ bool dev_rxdata_create(void) {
 }
 
 void dev_rxdata_destroy(void) {
+	stop_ring();
+	vfree(ring.slots);
 	free_memory(&rxdata_mem);
 	unregister_device(&rxdata_device);
 }
@@ -148,10 +525,16 @@ static struct file_operations lockdata_fops = {
 	.release = dev_anydata_release,
 	.llseek = dev_anydata_llseek,
 	.read = dev_anydata_read,
+	.unlocked_ioctl = dev_anydata_ioctl,
+	.mmap = dev_anydata_mmap,
 };
 
 bool dev_lockdata_create(void) {
-	if (!reserve_memory(&lockdata_device, MAX_LOCKDATA_BYTES, &lockdata_mem) || !write_address_to_fpga(LOCKDATA_ADDR_REG, &lockdata_mem)) {
+	if (!valid_memory_size("lockdata_bytes", lockdata_bytes)) {
+		return false;
+	}
+
+	if (!reserve_memory("lockdata_bytes", &lockdata_device, lockdata_bytes, &lockdata_mem) || !write_address_to_fpga(LOCKDATA_ADDR_REG, &lockdata_mem)) {
 		return false;
 	}
 
@@ -2,7 +2,8 @@
 #define _DEV_DATA_H
 
 /*
-Manages the /dev/rxdata & /dev/lockdata files
+Manages the /dev/rxdata & /dev/lockdata files.
+The acquisition memory can be read with lseek & read, or mmapped to be sent without a copy.
 */
 
 #include "linux_includes.h"
@@ -11,6 +12,13 @@ Manages the /dev/rxdata & /dev/lockdata files
 bool dev_rxdata_create(void);
 void dev_rxdata_destroy(void);
 
+//Queues the snapshot of a half of /dev/rxdata, from the interrupt handler, see data_device.h.
+//Returns 0, -ENODEV if the ring is disabled, or -EOVERFLOW if it is full: the half is lost.
+int dev_rxdata_snapshot(bool second_half);
+
+//Drops the snapshots queued, keeping the ring setup.
+void dev_rxdata_snapshot_reset(void);
+
 //Creates & destroy /dev/lockdata
 bool dev_lockdata_create(void);
 void dev_lockdata_destroy(void);
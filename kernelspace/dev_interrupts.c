@@ -6,16 +6,19 @@
 #include "klog.h"
 
 #include "../common/interrupt_codes.h"
+#include "../common/interrupt_device.h"
 
 static int device_open(struct inode *inode, struct file *filp);
 static int device_release(struct inode *inode, struct file *filp);
 static ssize_t device_read(struct file *filp, char __user *user_buffer, size_t count, loff_t *position);
+static long device_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 
 static struct file_operations device_fops = {
 	.owner = THIS_MODULE,
 	.open = device_open,
 	.release = device_release,
 	.read = device_read,
+	.unlocked_ioctl = device_ioctl,
 };
 
 static dynamic_device_t device;
@@ -23,6 +26,10 @@ static struct semaphore mutex;
 static dev_interrupts_callback_f opened_callback;
 static dev_interrupts_callback_f closed_callback;
 
+//only one process has the device open, see device_open()
+static bool record_mode;
+static interrupt_record_t records[INTERRUPT_QUEUE_CAPACITY];
+
 //-- 
 
 static int device_open(struct inode *inode, struct file *filp) {
@@ -35,6 +42,7 @@ static int device_open(struct inode *inode, struct file *filp) {
 
 	klog_info("got semaphore, emptying queue\n");
 	interrupt_queue_reset();
+	record_mode = false;
 	if (opened_callback != NULL && !opened_callback())
 		return -EINVAL;
 	
@@ -53,7 +61,31 @@ static int device_release(struct inode *inode, struct file *filp) {
 	return 0;
 }
 
-//blocking read, one char at a time
+//all the pending records fitting in the buffer
+static ssize_t read_records(char __user *user_buffer, size_t count, loff_t *position) {
+	int max = min_t(size_t, count / sizeof(interrupt_record_t), INTERRUPT_QUEUE_CAPACITY);
+	if (max == 0) {
+		klog_error("Buffer of %zu bytes too small for an interrupt record\n", count);
+		return -EINVAL;
+	}
+
+	int nrecords = interrupt_queue_take_records(records, max);
+	if (nrecords == 0) {
+		//empty queue, this is normal, userspace should read again
+		return 0;
+	}
+
+	ssize_t nbytes = nrecords * sizeof(interrupt_record_t);
+	if (copy_to_user(user_buffer, records, nbytes)) {
+		klog_error("Unable to copy %d interrupt records to userspace!\n", nrecords);
+		return -EFAULT;
+	}
+
+	*position += nbytes;
+	return nbytes;
+}
+
+//blocking read, one char at a time unless in record mode
 static ssize_t device_read(struct file *filp, char __user *user_buffer, size_t count, loff_t *position) {
 	if (filp->f_flags & O_NONBLOCK && interrupt_queue_is_empty()) {
 		//the caller could have set the O_NONBLOCK attribute, we must honor it.
@@ -61,6 +93,10 @@ static ssize_t device_read(struct file *filp, char __user *user_buffer, size_t c
 		return -EAGAIN;
 	}
 
+	if (record_mode) {
+		return read_records(user_buffer, count, position);
+	}
+
 	uint8_t value;
 	if (!interrupt_queue_take(&value)) {
 		//empty queue, this is normal, userspace should read again
@@ -78,6 +114,22 @@ static ssize_t device_read(struct file *filp, char __user *user_buffer, size_t c
 	return nbytes;
 }
 
+//switches between single bytes and records, see interrupt_device.h
+static long device_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+	if (cmd != INTERRUPTS_IOCTL_RECORDS) {
+		return -ENOTTY;
+	}
+
+	uint32_t enabled;
+	if (copy_from_user(&enabled, (void __user*)arg, sizeof(enabled))) {
+		return -EFAULT;
+	}
+
+	record_mode = enabled != 0;
+	klog_info("interrupts are read as %s\n", record_mode ? "records" : "bytes");
+	return 0;
+}
+
 //--
 
 bool dev_interrupts_create(dev_interrupts_callback_f opened, dev_interrupts_callback_f closed) {
@@ -1,6 +1,8 @@
 #include "interrupt_queue.h"
 #include "klog.h"
 
+#include "../common/interrupt_codes.h"
+
 typedef struct {
 	int8_t value;
 	ktime_t time;
@@ -121,6 +123,34 @@ bool interrupt_queue_take(uint8_t* value) {
 	return true;
 }
 
+int interrupt_queue_take_records(interrupt_record_t* records, int max) {
+	progressive_wait();
+
+	unsigned long irqflags;
+	spin_lock_irqsave(&spinlock, irqflags);
+
+	int count = 0;
+	while (size > 0 && count < max) {
+		timed_value_t timedvalue = buffer[next_read];
+		records[count] = (interrupt_record_t) { .time_ns = ktime_to_ns(timedvalue.time), .code = timedvalue.value };
+		next_read = (next_read + 1) % INTERRUPT_QUEUE_CAPACITY;
+		size--;
+		count++;
+
+		uint8_t code = timedvalue.value;
+		if (code == INTERRUPT_ACQUISITION_HALF_FULL || code == INTERRUPT_ACQUISITION_FULL) {
+			break;
+		}
+	}
+
+	if (count > 0) {
+		empty_takes = 0;
+	}
+
+	spin_unlock_irqrestore(&spinlock, irqflags);
+	return count;
+}
+
 void interrupt_queue_status(int *qsize, int *qnext_read, int *qnext_write, ulong *qempty_takes) {
 	*qsize = size;
 	*qnext_read = next_read;
@@ -11,8 +11,10 @@ It will not block when trying to add a value to a full queue, but will report an
 */
 
 #include "linux_includes.h"
+#include "../common/interrupt_device.h"
 
-#define INTERRUPT_QUEUE_CAPACITY 16
+//room for the data interrupts of a full snapshot ring, SNAPSHOT_MAX_DEPTH in dev_data.c
+#define INTERRUPT_QUEUE_CAPACITY 64
 
 //Clears the content of the queue.
 void interrupt_queue_reset(void);
@@ -31,6 +33,12 @@ bool interrupt_queue_add(uint8_t value);
 //May wait a bit if the queue is empty.
 bool interrupt_queue_take(uint8_t* value);
 
+//Takes up to max values from the start of the queue at once, with their time.
+//May wait a bit if the queue is empty, returns the number of records filled.
+//Stops after an ACQUISITION_(HALF_)FULL, the next ones staying queued where interrupt_queue_contains() sees them
+//until it is handled, as when taken one by one.
+int interrupt_queue_take_records(interrupt_record_t* records, int max);
+
 //Asks for queue status, used for logging only.
 void interrupt_queue_status(int *qsize, int *qnext_read, int *qnext_write, ulong *qempty_takes);
 
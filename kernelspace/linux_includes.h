@@ -18,6 +18,7 @@ Project includes should not be added here, only unmodifiable system includes.
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 #include <linux/semaphore.h>
 #include <linux/kernel.h>
@@ -31,5 +32,9 @@ Project includes should not be added here, only unmodifiable system includes.
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
 
 #endif
\ No newline at end of file
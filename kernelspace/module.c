@@ -1,13 +1,17 @@
 /*
 This modules has several features:
 1. enable the fpga bridges, making them available through /dev/mem
-2. reserve and expose a chunk of memory in sdram for acquisition data
+2. reserve and expose a chunk of memory in sdram for acquisition data, to read or mmap
 3. gets interrupts from GPIO irqs and expose them through a char device.
 
 Each time a GPIO irq happens, a corresponding interrupt code is put in a FIFO.
 The char device (/dev/interrupts) allows blocking reads, one char at a time. 
 The bytes read from /dev/interrupts comes from the FIFO. When it is empty, the call to read blocks.
 It resumes as soon as an interrupt code is in the FIFO, thus ensuring a fast transmission to userspace.
+
+When userspace sets up the snapshot ring of /dev/rxdata, each acquisition half is copied by the module
+as soon as its interrupt happens, so several data interrupts can wait in the FIFO. Otherwise a second
+data interrupt arriving before the first one was handled is a failure, the half having been overwritten.
 */
 
 #include "../common/interrupt_codes.h"
@@ -27,6 +31,7 @@ static bool failure = false;
 static bool dev_interrupts_opened(void) {
 	klog_info("/dev/interrupts opened, enabled irqs\n");
 	failure = false;
+	dev_rxdata_snapshot_reset();
 
 	if (enable_gpio_irqs() != 0) {
 		klog_error("unable to enable GPIO IRQs\n");
@@ -61,8 +66,18 @@ static void publish_interrupt(gpio_irq_t* gpioirq) {
 		gpioirq->code, gpioirq->name,
 		qsize, qnext_read, qnext_write, qempty_takes);
 
-	//ensure that a previous ACQUISITION_(HALF_)FULL isn't in the queue, otherwise it would mean a data corruption
-	if (is_acqdata_interrupt(gpioirq->code) && interrupt_queue_contains(gpioirq->code)) {
+	int snapshot = is_acqdata_interrupt(gpioirq->code) ? dev_rxdata_snapshot(gpioirq->code == INTERRUPT_ACQUISITION_FULL) : -ENODEV;
+	if (snapshot == -EOVERFLOW) {
+		failure = true;
+		klog_error("The snapshot ring is full, data interrupt lost: 0x%x (%s)!\n", gpioirq->code, gpioirq->name);
+		klog_error("Stopping interruption handling.\n");
+		interrupt_queue_reset();
+		interrupt_queue_add(INTERRUPT_FAILURE);
+		return;
+	}
+
+	//without snapshot, ensure that a previous ACQUISITION_(HALF_)FULL isn't in the queue, otherwise it would mean a data corruption
+	if (snapshot == -ENODEV && is_acqdata_interrupt(gpioirq->code) && interrupt_queue_contains(gpioirq->code)) {
 		failure = true;
 		klog_error("A previous data interrupt wasn't already handled: 0x%x (%s)!\n", gpioirq->code, gpioirq->name);
 		klog_error("Stopping interruption handling.\n");
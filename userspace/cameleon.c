@@ -18,6 +18,9 @@
 #include "udp_broadcaster.h"
 #include "hardware.h"
 #include "hps_sequence.h"
+#include "sequence_rams.h"
+#include "hps_rxtx_seq.h"
+#include "ddr_layout.h"
 
 void* reserved_mem_base;
 
@@ -171,18 +174,24 @@ int cameleon_main(int argc, char ** argv) {
 	}
 
 
-	int fd;
-	if ((fd = open("/dev/mem", (O_RDWR | O_SYNC))) == -1) {
-		printf("ERROR: could not open \"/dev/mem\"...\n");
+	if (!ddr_layout_init(config_events_window_bytes())) {
+		log_error("Unable to lay out the sequence DDR, exiting");
 		return 1;
 	}
 
-	//reserve space for seq
-	//use reserved mem
-	reserved_mem_base = mmap(NULL, HPS_RESERVED_SPAN, (PROT_READ | PROT_WRITE),
-		MAP_SHARED, fd, HPS_RESERVED_ADDRESS);
-	if (reserved_mem_base == MAP_FAILED) {
-		printf("reg cannot reserved mem \n");
+	//reserved space for seq, events windows and dmacs stay mapped until exit
+	if (!shared_memory_map_regions(config_memory_populate())) {
+		log_error("Unable to map sequence regions, exiting");
+		return 1;
+	}
+	reserved_mem_base = ddr_view(DDR_SEQUENCE_RAMS, 0, 0, SEQUENCE_RAM_SLOTS * RAM_OFFSET_STEP);
+
+	if (reserved_mem_base == NULL || !sequence_rams_init(reserved_mem_base)) {
+		return 1;
+	}
+
+	if (!rxtx_seq_service_start()) {
+		log_error("Unable to start rxtx service, exiting");
 		return 1;
 	}
 
@@ -204,6 +213,7 @@ int cameleon_main(int argc, char ** argv) {
 
 	//TODO call atexit() instead so everything is still cleared 
 	//even if init failed or if user kills the process
+	rxtx_seq_service_stop();
 	monitoring_stop();
 	udp_broadcaster_stop();
 	interrupt_reader_stop();
@@ -215,16 +225,9 @@ int cameleon_main(int argc, char ** argv) {
 	destroy_command_handlers();
 	destroy_interrupt_handlers();
 
+	sequence_rams_destroy();
 	shared_memory_close();
 
-	if (munmap(reserved_mem_base, HPS_RESERVED_SPAN) != 0) {
-		printf("ERROR: munmap() failed...\n");
-		close(fd);
-		return 1;
-	}
-
-	close(fd);
-
 
 	log_close();
 	return 0;
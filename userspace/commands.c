@@ -8,6 +8,7 @@
 #include "sequence_params.h"
 #include "hardware.h"
 #include "lock_interrupts.h"
+#include "sequencer_interrupts.h"
 #include "config.h"
 #include "shim_config_files.h"
 #include "hw_amps.h"
@@ -17,6 +18,7 @@
 #include "hps_sequence.h"
 #include "fpga_dma.h"
 #include "hps_rxtx_seq.h"
+#include "sequence_rams.h"
 
 
 //probably not the correct place to define this, but not used anywhere else
@@ -44,6 +46,24 @@ static void cmd_close(clientsocket_t* client, header_t* header, const void* body
 	clientsocket_close(client);
 }
 
+//the run in progress may be sending the events of the active bank, they are not replaced under it
+static void upload_events(int ram_id, uint32_t offset, const void* body, uint32_t nbytes) {
+	if (rxtx_seq_running()) {
+		log_error("Unable to upload %u bytes of events at %u, a sequence is running", nbytes, offset);
+	}
+	else if (events_upload(ram_id == RAM_DDR_RF_EVENTS ? EVENT_STREAM_RF : EVENT_STREAM_GRAD, offset, body, nbytes)) {
+		return;
+	}
+
+	message_t* message = create_message(MSG_EVENTS_UPLOAD_REJECTED);
+	if (message != NULL) {
+		message->header.param1 = ram_id;
+		message->header.param2 = offset;
+		message->header.param3 = nbytes;
+		sequencer_interrupts_send(message);
+	}
+}
+
 static void cmd_write(clientsocket_t* client, header_t* header, const void* body) {
 	int ram_id = header->param1;
 	int device_address = header->param2;
@@ -59,19 +79,26 @@ static void cmd_write(clientsocket_t* client, header_t* header, const void* body
  
 	//stupid registers......
 	if (ram_id >= 100 && ram_id <= 100+299 &&nbytes==4) {
-		//reg offset 
-		uint32_t regs_offset = 131072 * 87;
 		uint32_t current_reg = ram_id - 100;
 
 		//printf("reg value : %x \n\n", *(uint32_t*)body)
-		uint32_t* base_of_regs = (uint32_t*)reserved_mem_base + regs_offset+ current_reg;
-		//check if it's inside span
-		if ((uint32_t)base_of_regs >= ((uint32_t)reserved_mem_base + (uint32_t)HPS_RESERVED_SPAN)) {
-			printf("reg outside of memory, %d : %d\n", (uint32_t)base_of_regs, (uint32_t)HPS_RESERVED_SPAN);
+		//the FPGA would write the acquisition halves past the end of its memory
+		uint32_t half_full_words = (*(const uint32_t*)body & 0xFFFF) + 1;
+		if (current_reg == RAM_REGISTER_FIFO_INTERRUPT_SELECTED && !sequencer_interrupts_block_fits(half_full_words * sizeof(int32_t))) {
+			return;
+		}
+
+		bool deferred;
+		if (!sequence_rams_write_register(current_reg, *(const uint32_t*)body, &deferred)) {
+			return;
+		}
+		//staged for the next sequence, the hardware is written when it is swapped in
+		if (deferred) {
+			if (readback && !send_message(client, header, body)) {
+				log_error("Unable to send readback!");
+			}
 			return;
 		}
-		//printf("\n\n write reg %d , %d bytes to  %p mem base \n\n", ram_id, nbytes, base_of_regs);
-		memcpy(base_of_regs, body, nbytes);
 	}
 
  
@@ -129,17 +156,7 @@ static void cmd_write(clientsocket_t* client, header_t* header, const void* body
    
 	) {
 
-		uint32_t steps_of_ram = ram_id * 524288; //2^17
-		uint8_t* base_of_ram= (uint8_t*)reserved_mem_base + steps_of_ram;
-
-		//check if it's inside span
-		if ((uint32_t )base_of_ram >= ((uint32_t)reserved_mem_base + (uint32_t)HPS_RESERVED_SPAN)) {
-			printf("ram outside of memory\n");
-			return;
-		}
-     
-		//printf("\n\n write ram %d , %d bytes to  %p mem base \n\n",ram_id, nbytes, base_of_ram );
-		memcpy(base_of_ram, body, nbytes);
+		sequence_rams_write(ram_id, body, nbytes);
 		return;
 	}
  
@@ -148,6 +165,21 @@ static void cmd_write(clientsocket_t* client, header_t* header, const void* body
  
  
  
+	//stored with the sequence rams, it is read by the compiler
+	if (ram_id == RAM_DDR_LOOP_PROGRAM) {
+		if (!event_program_complete(body, nbytes)) {
+			log_error("Loop program of %u bytes shorter than its header, it is not written", nbytes);
+			return;
+		}
+		sequence_rams_write(SEQ_RAM_LOOP_PROGRAM, body, nbytes);
+		return;
+	}
+
+	//events compiled by the host, param4 is the offset of the chunk in bytes
+	if (ram_id == RAM_DDR_RF_EVENTS || ram_id == RAM_DDR_GRAD_EVENTS) {
+		upload_events(ram_id, header->param4, body, nbytes);
+		return;
+	}
 	if (ram_id == RAM_DDR_GRAD) {
 		
 		shared_memory_t* mem = shared_memory_acquire();
@@ -227,7 +259,9 @@ static void cmd_write(clientsocket_t* client, header_t* header, const void* body
 		sequence_params->number_half_full = value & 0xFFFF;
 		sequence_params->number_full = (value >> 16) & 0xFFFF;
 		log_info("Ram.id==RAM_REGISTER_FIFO_INTERRUPT_SELECTED half_full=%d, full=%d", sequence_params->number_half_full,sequence_params->number_full);
+		uint32_t block_bytes = (sequence_params->number_half_full + 1) * sizeof(int32_t);
 		sequence_params_release(sequence_params);
+		sequencer_interrupts_set_block_size(block_bytes);
 	}
 	if (ram.id == RAM_REGISTERS_SELECTED + RAM_REGISTER_DECFACTOR_SELECTED) {
 
@@ -412,10 +446,37 @@ bool zg_clicked=false;
 
 static void cmd_zg(clientsocket_t* client, header_t* header, const void* body) {
 	zg_clicked = true;
-	start_rxtx_seq();
-	//wait until fifo is written
-	usleep(1000);
-	start_sequence(false);
+	//the sequence starts as soon as the first events are in the fifos
+	if (start_rxtx_seq() && wait_rxtx_seq_ready()) {
+		start_sequence(false);
+	}
+}
+
+//staged registers go through cmd_write once their sequence is the active one
+static void write_staged_register(uint32_t index, uint32_t value) {
+	header_t header = {
+		.cmd = CMD_WRITE,
+		.param1 = RAM_REGISTERS_SELECTED + index,
+		.param2 = MOTHER_BOARD_ADDRESS,
+		.body_size = sizeof(value),
+	};
+	cmd_write(NULL, &header, &value);
+}
+
+static void cmd_zg_staged(clientsocket_t* client, header_t* header, const void* body) {
+	zg_clicked = true;
+	if (start_staged_rxtx_seq(write_staged_register) && wait_rxtx_seq_ready()) {
+		start_sequence(false);
+	}
+}
+
+static void cmd_sequence_stage(clientsocket_t* client, header_t* header, const void* body) {
+	if (header->param1 == 1) {
+		stage_rxtx_seq_begin();
+	}
+	else {
+		stage_rxtx_seq_end();
+	}
 }
 
 static void cmd_rs(clientsocket_t* client, header_t* header, const void* body) {
@@ -457,7 +518,8 @@ static void cmd_cam_init(clientsocket_t* client, header_t* header, const void* b
 }
 
 static void cmd_stop_sequence(clientsocket_t* client, header_t* header, const void* body) {
-	if(zg_clicked==true) stop_rxtx_seq();
+	//events being compiled or sent would otherwise keep the dmacs busy, whatever started them
+	stop_rxtx_seq();
 	stop_sequence();
 }
 
@@ -465,6 +527,10 @@ static void cmd_sequence_clear(clientsocket_t* client, header_t* header, const v
 	sequence_params_t* sequence_params=sequence_params_acquire();
 	sequence_params_clear(sequence_params);
 	sequence_params_release(sequence_params);
+	//the next sequence is compiled from its rams again, with the fixed nest unless it writes a loop program
+	events_upload_clear();
+	uint32_t no_program = 0;
+	sequence_rams_write(SEQ_RAM_LOOP_PROGRAM, &no_program, sizeof(no_program));
 }
 
 static void cmd_lock_sequence_on_off(clientsocket_t* client, header_t* header, const void* body) {
@@ -889,6 +955,8 @@ bool register_all_commands() {
 	success &= register_command_handler(CMD_RS, cmd_rs);
 	success &= register_command_handler(CMD_STOP_SEQUENCE, cmd_stop_sequence);
 	success &= register_command_handler(CMD_SEQUENCE_CLEAR, cmd_sequence_clear);
+	success &= register_command_handler(CMD_SEQUENCE_STAGE, cmd_sequence_stage);
+	success &= register_command_handler(CMD_ZG_STAGED, cmd_zg_staged);
 
 	success &= register_command_handler(CMD_LOCK_SEQ_ON_OFF, cmd_lock_sequence_on_off);
 	success &= register_command_handler(CMD_LOCK_SWEEP_ON_OFF, cmd_lock_sweep_on_off);
@@ -66,6 +66,8 @@ Command handlers: command id and implementation.
 #define CMD_TX_MIXER                                2000 + 0x0		//used by compiler
 
 #define CMD_SEQUENCE_CLEAR							4000 + 0x0		//used to know when to clear previous sequence params 
+#define CMD_SEQUENCE_STAGE							4000 + 0x1		//param1 1: next writes stage the next sequence, 0: done, compile it
+#define CMD_ZG_STAGED								4000 + 0x2		//swaps the staged sequence in and starts it
 
 //SHIM
 #define CMD_WRITE_SHIM								9000 + 0x1
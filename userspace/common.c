@@ -14,6 +14,48 @@ long long monotonic_ms()
 	return now;
 }
 
+/**
+ * Get the monotonic time, in microseconds
+ */
+long long monotonic_us()
+{
+	struct timespec ts_now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	long long now = ts_now.tv_sec * 1000000LL + ts_now.tv_nsec / 1000;
+	return now;
+}
+
+/**
+ * Get the CLOCK_REALTIME deadline of pthread_cond_timedwait(), timeout_ms from now
+ */
+void deadline_in_ms(struct timespec* deadline, int timeout_ms)
+{
+	clock_gettime(CLOCK_REALTIME, deadline);
+	deadline->tv_sec += timeout_ms / 1000;
+	deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * Read a parameter of the kernel module from /sys/module/modcameleon/parameters, false if it can't be read
+ */
+bool read_module_param(const char* name, uint32_t* value)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/module/modcameleon/parameters/%s", name);
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	bool read = fscanf(file, "%u", value) == 1;
+	fclose(file);
+	return read;
+}
+
 
 /*******************************************************************************
  * Function:	SystemSnprintfCat()
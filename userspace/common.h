@@ -18,6 +18,21 @@
  */
 long long monotonic_ms();
 
+/**
+ * Get the monotonic time, in microseconds
+ */
+long long monotonic_us();
+
+/**
+ * Get the CLOCK_REALTIME deadline of pthread_cond_timedwait(), timeout_ms from now
+ */
+void deadline_in_ms(struct timespec* deadline, int timeout_ms);
+
+/**
+ * Read a parameter of the kernel module from /sys/module/modcameleon/parameters, false if it can't be read
+ */
+bool read_module_param(const char* name, uint32_t* value);
+
 /*******************************************************************************
  * Function:	SystemSnprintfCat()
  * Parameters:	char *__restrict s, size_t n, const char *__restrict format, ...
@@ -0,0 +1,384 @@
+/*
+cameleon compile: runs the event compiler on sequence RAM images read from files,
+without FPGA nor DMA, and dumps the events to a file.
+
+Each RAM is read from <ramdir>/<ram id>.bin, a raw image starting at word 0 as sent with cmd_write,
+the registers being the RAM_REGISTERS_INDEX image. Missing RAMs are zeroed.
+The RF events are written as 128 bytes records, the gradient ones as 64 bytes records,
+so the dump can be compared byte per byte, or mmapped, to check changes of the compiler.
+
+With -j, the events are compiled by a compile pool of that many threads, which must give the same files.
+With -p, the packing of the TX groups is also timed alone, scalar against the kernel used by the compiler.
+With -t, each compiler variant which can compile the sequence is timed against the generic one, its events being checked.
+*/
+
+#include "std_includes.h"
+#include "event_compiler.h"
+#include "event_pack.h"
+#include "compile_pool.h"
+#include "common.h"
+#include "log.h"
+
+#define SEQUENCE_RAM_BYTES (SEQUENCE_RAM_WORDS * 4)
+//events of a compile pool slab
+#define SLAB_EVENTS 4096
+
+static void usage() {
+	fprintf(stderr, "usage: cameleon compile [-r repeat] [-j threads] [-p] [-t] [-a] <ramdir> <rf_events.bin> [grad_events.bin]\n");
+}
+
+//reads <dir>/<ram_id>.bin into ram, what the file does not cover is zeroed
+static bool load_ram(const char* dir, uint32_t ram_id, uint32_t* ram) {
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%u.bin", dir, ram_id);
+	memset(ram, 0, SEQUENCE_RAM_BYTES);
+
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		log_debug("No image for ram %u (%s), zeroed", ram_id, path);
+		return true;
+	}
+
+	size_t nread = fread(ram, 1, SEQUENCE_RAM_BYTES, f);
+	bool success = !ferror(f);
+	if (!success) {
+		log_error_errno("Unable to read %s", path);
+	}
+	else {
+		log_debug("Loaded %zu bytes of ram %u", nread, ram_id);
+	}
+	fclose(f);
+	return success;
+}
+
+//creates a file of the given size, mapped for writing
+static void* map_output(const char* path, uint64_t bytes) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		log_error_errno("Unable to create %s", path);
+		return NULL;
+	}
+
+	void* base = NULL;
+	if (ftruncate(fd, bytes) != 0) {
+		log_error_errno("Unable to resize %s to %llu bytes", path, (unsigned long long)bytes);
+	}
+	else if (bytes > 0) {
+		base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED) {
+			log_error_errno("Unable to mmap %s", path);
+			base = NULL;
+		}
+	}
+	close(fd);
+	return base;
+}
+
+//compiles the whole sequence with a compile pool, in slabs of SLAB_EVENTS
+static bool compile_parallel(const event_compiler_t* compiler, uint32_t* rf_events, uint32_t* grad_events, int nb_threads) {
+	uint32_t depth = 2 * nb_threads;
+	compile_pool_t pool;
+	if (!compile_pool_init(&pool, compiler, nb_threads, depth)) {
+		return false;
+	}
+
+	uint64_t nb_posted = 0;
+	bool posting = true;
+	while (posting || compile_pool_pending(&pool) > 0) {
+		while (posting && compile_pool_pending(&pool) < depth) {
+			uint32_t count = compile_pool_post(&pool, rf_events + nb_posted * EVENT_RF_WORDS,
+				grad_events != NULL ? grad_events + nb_posted * EVENT_GRAD_WORDS : NULL, SLAB_EVENTS);
+			nb_posted += count;
+			posting = count > 0;
+		}
+		compile_pool_wait(&pool);
+	}
+
+	compile_pool_destroy(&pool);
+	return true;
+}
+
+static void report(const char* what, uint64_t nb_events, uint64_t bytes, long long elapsed_us) {
+	double seconds = MAXIMUM(elapsed_us, 1) / 1e6;
+	printf("%s: %llu events, %llu bytes in %.3f ms, %.0f events/s, %.1f MB/s\n", what,
+		(unsigned long long)nb_events, (unsigned long long)bytes, elapsed_us / 1e3,
+		nb_events / seconds, bytes / seconds / 1e6);
+}
+
+//packs the TX groups of every row once per pass, the element values being those of the first pass
+static long long time_packing(const event_compiler_t* c, const uint32_t* values, uint32_t* out, uint64_t nb_passes, bool scalar) {
+	long long start = monotonic_us();
+	for (uint64_t p = 0; p < nb_passes; p++) {
+		const uint32_t* v = values;
+		uint32_t* o = out;
+		for (uint32_t r = 0; r < c->nb_rows; r++) {
+			if (scalar) {
+				event_pack_tx_scalar(c->rows[r].words + 2, v, v + SEQ_NB_OF_TX, v + 2 * SEQ_NB_OF_TX, o);
+			}
+			else {
+				event_pack_tx(c->rows[r].words + 2, v, v + SEQ_NB_OF_TX, v + 2 * SEQ_NB_OF_TX, o);
+			}
+			v += 3 * SEQ_NB_OF_TX;
+			o += EVENT_PACK_WORDS;
+		}
+	}
+	return monotonic_us() - start;
+}
+
+static bool pack_benchmark(const event_compiler_t* c, int repeat) {
+	uint32_t* values = malloc(c->nb_rows * 3 * SEQ_NB_OF_TX * sizeof(uint32_t));
+	uint32_t* scalar_out = calloc(c->nb_rows * EVENT_PACK_WORDS, sizeof(uint32_t));
+	uint32_t* kernel_out = calloc(c->nb_rows * EVENT_PACK_WORDS, sizeof(uint32_t));
+	bool success = values != NULL && scalar_out != NULL && kernel_out != NULL;
+	if (!success) {
+		log_error("Unable to allocate packing buffers for %u rows", c->nb_rows);
+		goto cleanup;
+	}
+
+	for (uint32_t r = 0; r < c->nb_rows; r++) {
+		const event_row_t* row = &c->rows[r];
+		uint32_t* v = values + r * 3 * SEQ_NB_OF_TX;
+		for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+			v[tx] = c->freq[tx][row->freq[tx].base];
+			v[SEQ_NB_OF_TX + tx] = c->amp[tx][row->amp[tx].base];
+			v[2 * SEQ_NB_OF_TX + tx] = c->phase[tx][row->phase[tx].base];
+		}
+	}
+
+	//as many packings as events in the sequence
+	uint64_t nb_passes = MAXIMUM(c->nb_events / c->nb_rows, 1);
+	long long scalar_us = 0;
+	long long kernel_us = 0;
+	for (int r = 0; r < repeat; r++) {
+		long long s = time_packing(c, values, scalar_out, nb_passes, true);
+		long long k = time_packing(c, values, kernel_out, nb_passes, false);
+		scalar_us = r == 0 ? s : MINIMUM(scalar_us, s);
+		kernel_us = r == 0 ? k : MINIMUM(kernel_us, k);
+	}
+
+	success = memcmp(scalar_out, kernel_out, c->nb_rows * EVENT_PACK_WORDS * sizeof(uint32_t)) == 0;
+	if (!success) {
+		log_error("The %s packing differs from the scalar one", EVENT_PACK_KERNEL);
+	}
+
+	uint64_t nb_packed = nb_passes * c->nb_rows;
+	printf("TX packing of %llu events: scalar %.1f ns/event, %s %.1f ns/event, x%.2f\n", (unsigned long long)nb_packed,
+		scalar_us * 1e3 / nb_packed, EVENT_PACK_KERNEL, kernel_us * 1e3 / nb_packed, (double)MAXIMUM(scalar_us, 1) / MAXIMUM(kernel_us, 1));
+
+cleanup:
+	free(values);
+	free(scalar_out);
+	free(kernel_out);
+	return success;
+}
+
+//compiles the sequence in slabs with the variant of tx_variant, checking them against the generic compiler.
+//*elapsed_us is the time spent in the variant only.
+static bool time_variant(const sequence_source_t* source, uint32_t tx_variant, uint32_t* out, uint32_t* reference, long long* elapsed_us) {
+	event_compiler_t variant, generic;
+	if (!event_compiler_init(&variant, source, EVENT_STREAM_RF)) {
+		return false;
+	}
+	if (!event_compiler_specialize(&variant, tx_variant) || !event_compiler_init(&generic, source, EVENT_STREAM_RF)) {
+		event_compiler_destroy(&variant);
+		return false;
+	}
+	event_compiler_specialize(&generic, SEQ_TX_ALL);
+
+	bool success = true;
+	*elapsed_us = 0;
+	uint32_t count;
+	do {
+		long long start = monotonic_us();
+		count = event_compiler_fill(&variant, out, SLAB_EVENTS);
+		*elapsed_us += monotonic_us() - start;
+
+		if (event_compiler_fill(&generic, reference, SLAB_EVENTS) != count
+			|| memcmp(out, reference, (size_t)count * EVENT_RF_BYTES) != 0) {
+			log_error("The events of the TX 0x%x variant differ from the generic ones", tx_variant);
+			success = false;
+		}
+	} while (success && count > 0);
+
+	event_compiler_destroy(&variant);
+	event_compiler_destroy(&generic);
+	return success;
+}
+
+static bool variant_benchmark(const sequence_source_t* source, uint32_t scanned_tx, uint64_t nb_events, int repeat) {
+	uint32_t* out = malloc(SLAB_EVENTS * EVENT_RF_BYTES);
+	uint32_t* reference = malloc(SLAB_EVENTS * EVENT_RF_BYTES);
+	bool success = out != NULL && reference != NULL;
+	if (!success) {
+		log_error("Unable to allocate variant buffers");
+	}
+
+	printf("Scanned TX: 0x%x\n", scanned_tx);
+	long long generic_us = 0;
+	//the generic compiler first, as the reference
+	for (int i = SEQ_TX_ALL; success && i >= 0; i--) {
+		uint32_t tx_variant = (uint32_t)i;
+		if ((scanned_tx & ~tx_variant) != 0) {
+			continue;
+		}
+
+		long long best_us = 0;
+		for (int r = 0; success && r < repeat; r++) {
+			long long elapsed;
+			success = time_variant(source, tx_variant, out, reference, &elapsed);
+			best_us = r == 0 ? elapsed : MINIMUM(best_us, elapsed);
+		}
+		if (!success) {
+			break;
+		}
+		if (tx_variant == SEQ_TX_ALL) {
+			generic_us = best_us;
+		}
+		printf("TX variant 0x%x: %.1f ns/event, x%.2f\n", tx_variant, best_us * 1e3 / MAXIMUM(nb_events, 1),
+			(double)MAXIMUM(generic_us, 1) / MAXIMUM(best_us, 1));
+	}
+
+	free(out);
+	free(reference);
+	return success;
+}
+
+//walks the sequence as SEQUENCE_ANALYTICS does before a run
+static void print_analytics(const event_compiler_t* c) {
+	event_analytics_t analytics;
+	long long start = monotonic_us();
+	event_compiler_analyze(c, &analytics);
+	long long elapsed = monotonic_us() - start;
+
+	double duration = MAXIMUM(analytics.duration, 1);
+	printf("Analytics of %llu events in %.3f ms: %llu timer ticks, TTL active %.2f %%\n", (unsigned long long)analytics.nb_events,
+		elapsed / 1e3, (unsigned long long)analytics.duration, 100 * analytics.ttl_on / duration);
+	for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		printf("TX%d: duty %.2f %%, energy %.6g\n", tx + 1, 100 * analytics.tx_on[tx] / duration, analytics.tx_energy[tx]);
+	}
+}
+
+int compile_main(int argc, char** argv) {
+	int repeat = 1;
+	int nb_threads = 1;
+	bool packing = false;
+	bool variants = false;
+	bool analytics = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:j:pta")) != -1) {
+		if (opt == 'r') {
+			repeat = MAXIMUM(atoi(optarg), 1);
+		}
+		else if (opt == 'j') {
+			nb_threads = MAXIMUM(atoi(optarg), 1);
+		}
+		else if (opt == 'p') {
+			packing = true;
+		}
+		else if (opt == 't') {
+			variants = true;
+		}
+		else if (opt == 'a') {
+			analytics = true;
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (argc - optind < 2 || argc - optind > 3) {
+		usage();
+		return 1;
+	}
+	const char* ramdir = argv[optind];
+	const char* rf_path = argv[optind + 1];
+	const char* grad_path = argc - optind == 3 ? argv[optind + 2] : NULL;
+
+	//same layout as the reserved ddr
+	uint32_t* rams = malloc((size_t)SEQUENCE_RAM_SLOTS * SEQUENCE_RAM_BYTES);
+	if (rams == NULL) {
+		log_error("Unable to allocate sequence rams");
+		return 1;
+	}
+
+	int result = 1;
+	sequence_source_t source;
+	sequence_source_from_reserved(&source, rams);
+	for (uint32_t i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		if ((i == RAM_REGISTERS_INDEX || event_compiler_reads_ram(i)) && !load_ram(ramdir, i, rams + i * SEQUENCE_RAM_WORDS)) {
+			goto cleanup;
+		}
+	}
+
+	event_compiler_t compiler;
+	if (!event_compiler_init(&compiler, &source, EVENT_STREAM_RF)) {
+		goto cleanup;
+	}
+	uint64_t nb_events = compiler.nb_events;
+	uint32_t scanned_tx = compiler.scanned_tx;
+	if (analytics) {
+		print_analytics(&compiler);
+	}
+	bool packed = !packing || pack_benchmark(&compiler, repeat);
+	event_compiler_destroy(&compiler);
+	if (!packed || (variants && !variant_benchmark(&source, scanned_tx, nb_events, repeat))) {
+		goto cleanup;
+	}
+
+	uint32_t* rf_events = map_output(rf_path, nb_events * EVENT_RF_BYTES);
+	uint32_t* grad_events = grad_path != NULL ? map_output(grad_path, nb_events * EVENT_GRAD_BYTES) : NULL;
+	if ((nb_events > 0 && rf_events == NULL) || (nb_events > 0 && grad_path != NULL && grad_events == NULL)) {
+		goto unmap;
+	}
+
+	//the first run also faults the output pages in, the best run is the compiler alone
+	long long best_us = 0;
+	for (int r = 0; r < repeat; r++) {
+		if (!event_compiler_init(&compiler, &source, EVENT_STREAM_RF)) {
+			goto unmap;
+		}
+
+		uint64_t nb_compiled = 0;
+		long long start = monotonic_us();
+		if (nb_threads > 1) {
+			if (!compile_parallel(&compiler, rf_events, grad_events, nb_threads)) {
+				event_compiler_destroy(&compiler);
+				goto unmap;
+			}
+		}
+		else if (grad_events != NULL) {
+			uint32_t count;
+			while ((count = event_compiler_fill_both(&compiler, rf_events + nb_compiled * EVENT_RF_WORDS,
+				grad_events + nb_compiled * EVENT_GRAD_WORDS, UINT32_MAX)) > 0) {
+				nb_compiled += count;
+			}
+		}
+		else {
+			uint32_t count;
+			while ((count = event_compiler_fill(&compiler, rf_events + nb_compiled * EVENT_RF_WORDS, UINT32_MAX)) > 0) {
+				nb_compiled += count;
+			}
+		}
+		long long elapsed = monotonic_us() - start;
+		event_compiler_destroy(&compiler);
+
+		if (r == 0 || elapsed < best_us) {
+			best_us = elapsed;
+		}
+	}
+
+	uint64_t bytes = nb_events * (EVENT_RF_BYTES + (grad_events != NULL ? EVENT_GRAD_BYTES : 0));
+	report(grad_events != NULL ? "RF and gradient events" : "RF events", nb_events, bytes, best_us);
+	result = 0;
+
+unmap:
+	if (rf_events != NULL) {
+		munmap(rf_events, nb_events * EVENT_RF_BYTES);
+	}
+	if (grad_events != NULL) {
+		munmap(grad_events, nb_events * EVENT_GRAD_BYTES);
+	}
+cleanup:
+	free(rams);
+	return result;
+}
@@ -0,0 +1,157 @@
+#include "compile_pool.h"
+#include "common.h"
+#include "log.h"
+
+//the thread waiting for a slab can be cancelled, the mutex must not stay locked
+static void unlock_mutex(void* mutex) {
+	pthread_mutex_unlock((pthread_mutex_t*)mutex);
+}
+
+static void compile_slab(const compile_pool_t* pool, compile_slab_t* slab) {
+	//the copy shares the decoded rows, only the scan state is its own
+	event_compiler_t compiler = *pool->compiler;
+	event_compiler_seek(&compiler, slab->first_event);
+
+	if (slab->grad_out != NULL) {
+		event_compiler_fill_both(&compiler, slab->out, slab->grad_out, slab->nb_events);
+	}
+	else {
+		event_compiler_fill(&compiler, slab->out, slab->nb_events);
+	}
+}
+
+static void* worker_thread(void* arg) {
+	compile_pool_t* pool = (compile_pool_t*)arg;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stopping && pool->taken == pool->posted) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->stopping) {
+			break;
+		}
+
+		compile_slab_t* slab = &pool->slabs[pool->taken++ % pool->depth];
+		pthread_mutex_unlock(&pool->mutex);
+
+		long long start = monotonic_us();
+		compile_slab(pool, slab);
+		long long elapsed = monotonic_us() - start;
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->compile_us += elapsed;
+		slab->ready = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+bool compile_pool_init(compile_pool_t* pool, const event_compiler_t* compiler, uint32_t nb_threads, uint32_t depth) {
+	memset(pool, 0, sizeof(compile_pool_t));
+	pool->compiler = compiler;
+	pool->depth = depth;
+
+	pool->slabs = calloc(depth, sizeof(compile_slab_t));
+	pool->threads = calloc(nb_threads, sizeof(pthread_t));
+	if (pool->slabs == NULL || pool->threads == NULL) {
+		log_error("Unable to allocate a compile pool of %u threads", nb_threads);
+		free(pool->slabs);
+		free(pool->threads);
+		return false;
+	}
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		log_error("Unable to init mutex");
+		free(pool->slabs);
+		free(pool->threads);
+		return false;
+	}
+
+	if (pthread_cond_init(&pool->cond, NULL) != 0) {
+		log_error("Unable to init condition");
+		pthread_mutex_destroy(&pool->mutex);
+		free(pool->slabs);
+		free(pool->threads);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < nb_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_thread, pool) != 0) {
+			log_error_errno("Unable to create compile thread %u", i);
+			compile_pool_destroy(pool);
+			return false;
+		}
+		pool->nb_threads++;
+	}
+
+	return true;
+}
+
+void compile_pool_destroy(compile_pool_t* pool) {
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (uint32_t i = 0; i < pool->nb_threads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->slabs);
+	free(pool->threads);
+	pool->slabs = NULL;
+	pool->threads = NULL;
+}
+
+uint32_t compile_pool_post(compile_pool_t* pool, uint32_t* out, uint32_t* grad_out, uint32_t max_events) {
+	uint64_t remaining = pool->compiler->nb_events - pool->next_event;
+	uint32_t nb_events = MINIMUM(remaining, max_events);
+	if (nb_events == 0) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	compile_slab_t* slab = &pool->slabs[pool->posted % pool->depth];
+	slab->out = out;
+	slab->grad_out = grad_out;
+	slab->first_event = pool->next_event;
+	slab->nb_events = nb_events;
+	slab->ready = false;
+	pool->posted++;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	pool->next_event += nb_events;
+	return nb_events;
+}
+
+uint32_t compile_pool_pending(compile_pool_t* pool) {
+	pthread_mutex_lock(&pool->mutex);
+	uint32_t pending = pool->posted - pool->returned;
+	pthread_mutex_unlock(&pool->mutex);
+
+	return pending;
+}
+
+uint32_t compile_pool_wait(compile_pool_t* pool) {
+	uint32_t nb_events = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	pthread_cleanup_push(unlock_mutex, &pool->mutex);
+	if (pool->returned != pool->posted) {
+		compile_slab_t* slab = &pool->slabs[pool->returned % pool->depth];
+		while (!slab->ready) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		nb_events = slab->nb_events;
+		pool->returned++;
+	}
+	pthread_cleanup_pop(1);
+
+	return nb_events;
+}
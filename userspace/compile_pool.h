@@ -0,0 +1,60 @@
+#ifndef _COMPILE_POOL_H_
+#define _COMPILE_POOL_H_
+
+/*
+Threads compiling ranges of the scan of a sequence in parallel.
+
+The events are cut in slabs of consecutive events, posted in scan order with the staging memory
+they are compiled into. Each worker takes the oldest posted slab, compiles it with its own copy of
+the compiler seeked to the first event of the slab, then marks it ready. compile_pool_wait() returns
+the slabs in the order they were posted, whatever worker is done first, so they can be handed to
+the DMA in scan order and the FPGA gets the same events as from a single compiler.
+*/
+
+#include "std_includes.h"
+#include "event_compiler.h"
+
+typedef struct {
+	uint32_t* out;
+	uint32_t* grad_out;			//NULL, or the gradient events when compiling both streams at once
+	uint64_t first_event;
+	uint32_t nb_events;
+	bool ready;
+} compile_slab_t;
+
+typedef struct {
+	const event_compiler_t* compiler;
+	uint64_t next_event;		//first event of the next slab
+
+	compile_slab_t* slabs;
+	uint32_t depth;
+	uint32_t posted;			//slabs posted
+	uint32_t taken;				//slabs taken by a worker
+	uint32_t returned;			//slabs returned by compile_pool_wait()
+	bool stopping;
+	long long compile_us;		//spent compiling, summed over the workers
+
+	pthread_t* threads;
+	uint32_t nb_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} compile_pool_t;
+
+//Starts nb_threads workers compiling the sequence of compiler from its first event, at most depth slabs being pending.
+//The compiler must not change until the pool is destroyed.
+bool compile_pool_init(compile_pool_t* pool, const event_compiler_t* compiler, uint32_t nb_threads, uint32_t depth);
+
+//Stops the workers once their current slab is compiled.
+void compile_pool_destroy(compile_pool_t* pool);
+
+//Posts the next max_events events, or what is left of the sequence, to be compiled into out (and grad_out).
+//The caller keeps at most depth slabs pending. Returns the number of events posted, 0 once the whole sequence was.
+uint32_t compile_pool_post(compile_pool_t* pool, uint32_t* out, uint32_t* grad_out, uint32_t max_events);
+
+//Number of posted slabs not returned yet.
+uint32_t compile_pool_pending(compile_pool_t* pool);
+
+//Waits for the oldest pending slab to be compiled and returns its number of events.
+uint32_t compile_pool_wait(compile_pool_t* pool);
+
+#endif
@@ -27,6 +27,41 @@
 
 #define ENV_HW_UPD_PORT "UDP_PORT"
 
+#define ENV_EVENT_RING_SLOTS "EVENT_RING_SLOTS"
+#define DEFAULT_EVENT_RING_SLOTS 4
+
+#define ENV_EVENT_WINDOW_BYTES "EVENT_WINDOW_BYTES"
+#define DEFAULT_EVENT_WINDOW_BYTES 65536
+
+#define ENV_MEMORY_POPULATE "MEMORY_POPULATE"
+#define DEFAULT_MEMORY_POPULATE 1
+
+#define ENV_EVENT_CACHE "EVENT_CACHE"
+#define DEFAULT_EVENT_CACHE 1
+
+#define ENV_DMA_TIMEOUT_MS "DMA_TIMEOUT_MS"
+#define DEFAULT_DMA_TIMEOUT_MS 60000
+
+#define ENV_DMA_EMULATED_RATE "DMA_EMULATED_RATE"
+
+#define ENV_COMPILE_THREADS "COMPILE_THREADS"
+#define DEFAULT_COMPILE_THREADS 0
+
+#define ENV_PREFILL_EVENTS "PREFILL_EVENTS"
+#define DEFAULT_PREFILL_EVENTS 128
+
+#define ENV_READY_TIMEOUT_MS "READY_TIMEOUT_MS"
+#define DEFAULT_READY_TIMEOUT_MS 100
+
+#define ENV_ABORT_TIMEOUT_MS "ABORT_TIMEOUT_MS"
+#define DEFAULT_ABORT_TIMEOUT_MS 2000
+
+#define ENV_SEQUENCE_ANALYTICS "SEQUENCE_ANALYTICS"
+#define DEFAULT_SEQUENCE_ANALYTICS 0
+
+#define ENV_RF_DUTY_LIMIT "RF_DUTY_LIMIT"
+#define DEFAULT_RF_DUTY_LIMIT 0
+
 
 //--
 
@@ -111,4 +146,67 @@ int config_upd_port() {
 int config_lock_hold_option() {
 	char* hoption = getenv(ENV_HW_LOCK_HOLD_OPTION);
 	return hoption == NULL ? 0 : atoi(hoption);
-}
\ No newline at end of file
+}
+
+int config_event_ring_slots() {
+	char* slots = getenv(ENV_EVENT_RING_SLOTS);
+	return slots == NULL ? DEFAULT_EVENT_RING_SLOTS : atoi(slots);
+}
+
+int config_events_window_bytes() {
+	char* bytes = getenv(ENV_EVENT_WINDOW_BYTES);
+	return bytes == NULL ? DEFAULT_EVENT_WINDOW_BYTES : atoi(bytes);
+}
+
+bool config_event_cache() {
+	char* cache = getenv(ENV_EVENT_CACHE);
+	return cache == NULL ? DEFAULT_EVENT_CACHE : atoi(cache) != 0;
+}
+
+bool config_memory_populate() {
+	char* populate = getenv(ENV_MEMORY_POPULATE);
+	return populate == NULL ? DEFAULT_MEMORY_POPULATE : atoi(populate) != 0;
+}
+
+int config_dma_timeout_ms() {
+	char* timeout = getenv(ENV_DMA_TIMEOUT_MS);
+	return timeout == NULL ? DEFAULT_DMA_TIMEOUT_MS : atoi(timeout);
+}
+
+double config_dma_emulated_rate() {
+	char* rate = getenv(ENV_DMA_EMULATED_RATE);
+	return rate == NULL ? 0 : atof(rate);
+}
+
+int config_compile_threads() {
+	char* threads = getenv(ENV_COMPILE_THREADS);
+	int nb_threads = threads == NULL ? DEFAULT_COMPILE_THREADS : atoi(threads);
+	//0: one per core
+	long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return nb_threads > 0 ? nb_threads : nb_cores > 0 ? nb_cores : 1;
+}
+
+int config_prefill_events() {
+	char* events = getenv(ENV_PREFILL_EVENTS);
+	return events == NULL ? DEFAULT_PREFILL_EVENTS : atoi(events);
+}
+
+int config_ready_timeout_ms() {
+	char* timeout = getenv(ENV_READY_TIMEOUT_MS);
+	return timeout == NULL ? DEFAULT_READY_TIMEOUT_MS : atoi(timeout);
+}
+
+int config_abort_timeout_ms() {
+	char* timeout = getenv(ENV_ABORT_TIMEOUT_MS);
+	return timeout == NULL ? DEFAULT_ABORT_TIMEOUT_MS : atoi(timeout);
+}
+
+bool config_sequence_analytics() {
+	char* analytics = getenv(ENV_SEQUENCE_ANALYTICS);
+	return analytics == NULL ? DEFAULT_SEQUENCE_ANALYTICS : atoi(analytics) != 0;
+}
+
+double config_rf_duty_limit() {
+	char* limit = getenv(ENV_RF_DUTY_LIMIT);
+	return limit == NULL ? DEFAULT_RF_DUTY_LIMIT : atof(limit);
+}
@@ -62,4 +62,17 @@ int config_upd_port();
 
 int config_lock_hold_option();
 
+int config_event_ring_slots();
+int config_events_window_bytes();
+bool config_event_cache();
+bool config_memory_populate();
+int config_dma_timeout_ms();
+double config_dma_emulated_rate();
+int config_compile_threads();
+int config_prefill_events();
+int config_ready_timeout_ms();
+int config_abort_timeout_ms();
+bool config_sequence_analytics();
+double config_rf_duty_limit();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "ddr_layout.h"
+#include "sequence_rams.h"
+#include "memory_map.h"
+#include "log.h"
+
+//the ring of an events window needs two 16kB slots
+#define MIN_WINDOW_BYTES 32768
+
+static bool initialized = false;
+
+//in the order they are placed in their region
+static ddr_area_t areas[NB_OF_DDR_AREAS] = {
+	//room for 128 rams, SEQUENCE_RAM_SLOTS of them are used
+	[DDR_SEQUENCE_RAMS] = { .name = "sequence rams", .region = REGION_RESERVED, .item_bytes = RAM_OFFSET_STEP, .nb_items = 128 },
+	[DDR_RF_EVENTS_CACHE] = { .name = "rf events cache", .region = REGION_RESERVED, .item_bytes = 150994944, .nb_items = SEQUENCE_RAM_BANKS },
+	[DDR_GRAD_EVENTS_CACHE] = { .name = "gradient events cache", .region = REGION_RESERVED, .item_bytes = 75497472, .nb_items = SEQUENCE_RAM_BANKS },
+	[DDR_RF_EVENTS_WINDOW] = { .name = "rf events window", .region = REGION_EVENTS, .nb_items = 1 },
+	[DDR_GRAD_EVENTS_WINDOW] = { .name = "gradient events window", .region = REGION_EVENTS, .nb_items = 1 },
+};
+
+//--
+
+static uint32_t region_address(region_id_t region) {
+	return region == REGION_RESERVED ? RESERVED_ADDRESS : EVENTS_ADDRESS;
+}
+
+static uint32_t region_limit(region_id_t region) {
+	return region == REGION_RESERVED ? RESERVED_SPAN : EVENTS_SPAN;
+}
+
+static uint64_t area_bytes(const ddr_area_t* area) {
+	return (uint64_t)area->item_bytes * area->nb_items;
+}
+
+bool ddr_layout_init(uint32_t window_bytes) {
+	if (window_bytes < MIN_WINDOW_BYTES || window_bytes % 4096 != 0) {
+		log_error("Invalid events window of %u bytes, at least %u in whole pages", window_bytes, MIN_WINDOW_BYTES);
+		return false;
+	}
+	areas[DDR_RF_EVENTS_WINDOW].item_bytes = window_bytes;
+	areas[DDR_GRAD_EVENTS_WINDOW].item_bytes = window_bytes;
+
+	uint64_t ends[NB_OF_REGIONS] = { 0 };
+	for (int i = 0; i < NB_OF_DDR_AREAS; i++) {
+		ddr_area_t* area = &areas[i];
+		uint64_t start = ends[area->region];
+		ends[area->region] = start + area_bytes(area);
+		if (ends[area->region] > region_limit(area->region)) {
+			log_error("The %s (%llu bytes) does not fit in the %u bytes from 0x%x", area->name, (unsigned long long)area_bytes(area),
+				region_limit(area->region), region_address(area->region));
+			return false;
+		}
+		area->address = region_address(area->region) + (uint32_t)start;
+		log_debug("%s: 0x%x, %u x %u bytes", area->name, area->address, area->nb_items, area->item_bytes);
+	}
+
+	initialized = true;
+	log_info("DDR layout: events windows of %u bytes", window_bytes);
+	return true;
+}
+
+const ddr_area_t* ddr_area(ddr_area_id_t id) {
+	return &areas[id];
+}
+
+uint32_t ddr_layout_span(region_id_t region) {
+	if (!initialized) {
+		return 0;
+	}
+
+	uint64_t span = 0;
+	for (int i = 0; i < NB_OF_DDR_AREAS; i++) {
+		if (areas[i].region == region) {
+			span += area_bytes(&areas[i]);
+		}
+	}
+	return (uint32_t)span;
+}
+
+uint32_t ddr_address(ddr_area_id_t id, uint32_t item) {
+	return areas[id].address + item * areas[id].item_bytes;
+}
+
+void* ddr_view(ddr_area_id_t id, uint32_t item, uint32_t offset, uint32_t bytes) {
+	const ddr_area_t* area = &areas[id];
+	if (!initialized) {
+		log_error("Trying to view the %s, but the DDR layout isn't initialized!", area->name);
+		return NULL;
+	}
+
+	uint64_t start = (uint64_t)item * area->item_bytes + offset;
+	if (item >= area->nb_items || start + bytes > area_bytes(area)) {
+		log_error("%u bytes at %u in item %u are outside of the %s", bytes, offset, item, area->name);
+		return NULL;
+	}
+	return shared_memory_view(area->region, area->address + (uint32_t)start, bytes);
+}
@@ -0,0 +1,49 @@
+#ifndef _DDR_LAYOUT_H_
+#define _DDR_LAYOUT_H_
+
+/*
+Layout of the DDR used by the sequences, the only place its addresses are defined.
+
+The reserved region holds the sequence rams, then the compiled events caches, one per stream and bank
+of the sequence rams. The rf then gradient events windows follow the reserved region, in the events region.
+Their size is set at startup: each window holds the ring of slots between the compiler and a dmac, the larger
+the window the more slots can be queued ahead of the transfer in progress.
+*/
+
+#include "std_includes.h"
+#include "shared_memory.h"
+
+typedef enum {
+	DDR_SEQUENCE_RAMS,			//an item per ram id, as written by cmd_write
+	DDR_RF_EVENTS_CACHE,		//an item per bank of the sequence rams
+	DDR_GRAD_EVENTS_CACHE,
+	DDR_RF_EVENTS_WINDOW,
+	DDR_GRAD_EVENTS_WINDOW,
+	NB_OF_DDR_AREAS,
+} ddr_area_id_t;
+
+typedef struct {
+	const char* name;
+	region_id_t region;			//mapped region the area is in
+	uint32_t item_bytes;
+	uint32_t nb_items;
+	uint32_t address;			//physical address of the first item, set by ddr_layout_init()
+} ddr_area_t;
+
+//Places the areas one after the other in their region, with events windows of window_bytes.
+//Returns false, logging why, if they do not fit in their region.
+bool ddr_layout_init(uint32_t window_bytes);
+
+const ddr_area_t* ddr_area(ddr_area_id_t id);
+
+//Bytes of a region covered by its areas, which is all that is mapped of it. 0 for a region without areas.
+uint32_t ddr_layout_span(region_id_t region);
+
+//Physical address of an item, as seen by the dmacs.
+uint32_t ddr_address(ddr_area_id_t id, uint32_t item);
+
+//Virtual address of bytes at offset in an item, they may run over the next items of the area.
+//Returns NULL, logging why, if they are past the end of the area or the region isn't mapped.
+void* ddr_view(ddr_area_id_t id, uint32_t item, uint32_t offset, uint32_t bytes);
+
+#endif
@@ -0,0 +1,253 @@
+#include "dma_engine.h"
+#include "fpga_dmac_api.h"
+#include "common.h"
+#include "config.h"
+#include "log.h"
+
+//fifo is connected directly to dma
+#define DMA_TRANSFER_DST_DMAC 0x0
+
+//a thread cancelled while waiting must not leave the mutex locked
+static void unlock_mutex(void* mutex) {
+	pthread_mutex_unlock((pthread_mutex_t*)mutex);
+}
+
+static void reset_controller(dma_engine_t* engine) {
+	fpga_dma_write_reg(engine->regs, FPGA_DMA_CONTROL, FPGA_DMA_SOFTWARE_RESET);
+	fpga_dma_write_reg(engine->regs, FPGA_DMA_CONTROL, 0);
+	if (engine->emulated_rate > 0) {
+		//nothing resets a memory stand-in
+		fpga_dma_write_reg(engine->regs, FPGA_DMA_STATUS, 0);
+	}
+
+	fpga_dma_write_reg(engine->regs, FPGA_DMA_CONTROL, FPGA_DMA_QUADWORD_TRANSFERS | FPGA_DMA_END_WHEN_LENGHT_ZERO);
+	fpga_dma_write_reg(engine->regs, FPGA_DMA_WRITEADDRESS, DMA_TRANSFER_DST_DMAC);
+}
+
+static bool is_aborted(dma_engine_t* engine) {
+	return __atomic_load_n(&engine->aborted, __ATOMIC_ACQUIRE);
+}
+
+static dma_transfer_status_t run_transfer(dma_engine_t* engine, dma_descriptor_t* descriptor) {
+	void* regs = engine->regs;
+
+	//the data was written through an uncached mapping, make sure it reached the ddr
+	__sync_synchronize();
+	descriptor->start_us = monotonic_us();
+	fpga_dma_write_reg(regs, FPGA_DMA_READADDRESS, descriptor->source);
+	fpga_dma_write_reg(regs, FPGA_DMA_LENGTH, descriptor->length);
+	fpga_dma_write_bit(regs, FPGA_DMA_CONTROL, FPGA_DMA_GO, 1);
+
+	long long emulated_end_us = 0;
+	if (engine->emulated_rate > 0) {
+		emulated_end_us = descriptor->start_us + (long long)(descriptor->length * 1e6 / engine->emulated_rate);
+	}
+
+	dma_transfer_status_t status = DMA_TRANSFER_DONE;
+	while (fpga_dma_read_bit(regs, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
+		if (is_aborted(engine)) {
+			status = DMA_TRANSFER_ABORTED;
+			break;
+		}
+
+		long long now = monotonic_us();
+		if (emulated_end_us != 0 && now >= emulated_end_us) {
+			fpga_dma_write_bit(regs, FPGA_DMA_STATUS, FPGA_DMA_DONE, 1);
+			continue;
+		}
+		if (engine->timeout_us > 0 && now - descriptor->start_us > engine->timeout_us) {
+			status = DMA_TRANSFER_TIMEOUT;
+			break;
+		}
+
+		//leave the cpu to the producers while the fifo drains
+		sched_yield();
+	}
+	descriptor->end_us = monotonic_us();
+
+	if (status == DMA_TRANSFER_DONE) {
+		//reset the controls
+		fpga_dma_write_bit(regs, FPGA_DMA_CONTROL, FPGA_DMA_GO, 0);
+		fpga_dma_write_bit(regs, FPGA_DMA_STATUS, FPGA_DMA_DONE, 0);
+	}
+	else {
+		log_error("%s dma transfer of %u bytes at 0x%x %s after %lld us", engine->name, descriptor->length, descriptor->source,
+			status == DMA_TRANSFER_TIMEOUT ? "timed out" : "aborted", descriptor->end_us - descriptor->start_us);
+		reset_controller(engine);
+	}
+
+	return status;
+}
+
+static void* engine_thread(void* arg) {
+	dma_engine_t* engine = (dma_engine_t*)arg;
+
+	pthread_mutex_lock(&engine->mutex);
+	while (true) {
+		while (!engine->stopping && engine->completed == engine->queued) {
+			pthread_cond_wait(&engine->cond, &engine->mutex);
+		}
+		if (engine->completed == engine->queued) {
+			break;
+		}
+
+		dma_descriptor_t* descriptor = engine->queue[engine->completed % engine->queue_depth];
+		bool aborted = engine->aborted;
+		if (engine->idle_since_us != 0) {
+			engine->stats.starved_us += MAXIMUM(descriptor->submit_us - engine->idle_since_us, 0);
+			engine->idle_since_us = 0;
+		}
+		pthread_mutex_unlock(&engine->mutex);
+
+		descriptor->status = aborted ? DMA_TRANSFER_ABORTED : run_transfer(engine, descriptor);
+
+		pthread_mutex_lock(&engine->mutex);
+		if (descriptor->status == DMA_TRANSFER_DONE) {
+			long long duration = descriptor->end_us - descriptor->start_us;
+			engine->stats.transfers++;
+			engine->stats.bytes += descriptor->length;
+			engine->stats.busy_us += duration;
+			engine->stats.max_transfer_us = MAXIMUM(engine->stats.max_transfer_us, duration);
+		}
+		else {
+			if (descriptor->status == DMA_TRANSFER_TIMEOUT) {
+				engine->stats.timeouts++;
+			}
+			//whatever is queued after a failed transfer would reach the fifo out of order
+			__atomic_store_n(&engine->aborted, true, __ATOMIC_RELEASE);
+		}
+		engine->completed++;
+		if (engine->completed == engine->queued) {
+			engine->idle_since_us = monotonic_us();
+		}
+		pthread_cond_broadcast(&engine->cond);
+		pthread_mutex_unlock(&engine->mutex);
+
+		if (descriptor->completion != NULL) {
+			descriptor->completion(descriptor);
+		}
+
+		pthread_mutex_lock(&engine->mutex);
+	}
+	pthread_mutex_unlock(&engine->mutex);
+
+	return NULL;
+}
+
+bool dma_engine_init(dma_engine_t* engine, const char* name, void* regs, uint32_t queue_depth) {
+	memset(engine, 0, sizeof(dma_engine_t));
+	engine->name = name;
+	engine->regs = regs;
+	engine->queue_depth = queue_depth;
+	engine->emulated_rate = config_dma_emulated_rate();
+	engine->timeout_us = config_dma_timeout_ms() * 1000LL;
+
+	engine->queue = calloc(queue_depth, sizeof(dma_descriptor_t*));
+	if (engine->queue == NULL) {
+		log_error("Unable to allocate %s dma queue", name);
+		return false;
+	}
+
+	if (pthread_mutex_init(&engine->mutex, NULL) != 0) {
+		log_error("Unable to init mutex");
+		free(engine->queue);
+		return false;
+	}
+
+	if (pthread_cond_init(&engine->cond, NULL) != 0) {
+		log_error("Unable to init condition");
+		pthread_mutex_destroy(&engine->mutex);
+		free(engine->queue);
+		return false;
+	}
+
+	reset_controller(engine);
+
+	if (pthread_create(&engine->thread, NULL, engine_thread, engine) != 0) {
+		log_error_errno("Unable to create %s dma thread", name);
+		pthread_cond_destroy(&engine->cond);
+		pthread_mutex_destroy(&engine->mutex);
+		free(engine->queue);
+		return false;
+	}
+
+	if (engine->emulated_rate > 0) {
+		log_info("%s dma engine emulating transfers at %.0f bytes/s", name, engine->emulated_rate);
+	}
+	return true;
+}
+
+void dma_engine_destroy(dma_engine_t* engine) {
+	dma_engine_abort(engine);
+
+	pthread_mutex_lock(&engine->mutex);
+	engine->stopping = true;
+	pthread_cond_broadcast(&engine->cond);
+	pthread_mutex_unlock(&engine->mutex);
+	pthread_join(engine->thread, NULL);
+
+	pthread_cond_destroy(&engine->cond);
+	pthread_mutex_destroy(&engine->mutex);
+	free(engine->queue);
+	engine->queue = NULL;
+}
+
+bool dma_engine_submit(dma_engine_t* engine, dma_descriptor_t* descriptor) {
+	bool success = false;
+
+	descriptor->status = DMA_TRANSFER_QUEUED;
+	descriptor->submit_us = monotonic_us();
+
+	pthread_mutex_lock(&engine->mutex);
+	pthread_cleanup_push(unlock_mutex, &engine->mutex);
+	while (!engine->aborted && engine->queued - engine->completed == engine->queue_depth) {
+		pthread_cond_wait(&engine->cond, &engine->mutex);
+	}
+	if (!engine->aborted) {
+		engine->queue[engine->queued % engine->queue_depth] = descriptor;
+		engine->queued++;
+		pthread_cond_broadcast(&engine->cond);
+		success = true;
+	}
+	else {
+		descriptor->status = DMA_TRANSFER_ABORTED;
+	}
+	pthread_cleanup_pop(1);
+
+	return success;
+}
+
+uint32_t dma_engine_poll(dma_engine_t* engine) {
+	pthread_mutex_lock(&engine->mutex);
+	uint32_t pending = engine->queued - engine->completed;
+	pthread_mutex_unlock(&engine->mutex);
+
+	return pending;
+}
+
+bool dma_engine_wait_idle(dma_engine_t* engine) {
+	bool success;
+
+	pthread_mutex_lock(&engine->mutex);
+	pthread_cleanup_push(unlock_mutex, &engine->mutex);
+	while (engine->completed != engine->queued) {
+		pthread_cond_wait(&engine->cond, &engine->mutex);
+	}
+	success = !engine->aborted;
+	pthread_cleanup_pop(1);
+
+	return success;
+}
+
+void dma_engine_abort(dma_engine_t* engine) {
+	pthread_mutex_lock(&engine->mutex);
+	__atomic_store_n(&engine->aborted, true, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&engine->cond);
+	pthread_mutex_unlock(&engine->mutex);
+}
+
+void dma_engine_get_stats(dma_engine_t* engine, dma_engine_stats_t* stats) {
+	pthread_mutex_lock(&engine->mutex);
+	*stats = engine->stats;
+	pthread_mutex_unlock(&engine->mutex);
+}
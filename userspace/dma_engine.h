@@ -0,0 +1,94 @@
+#ifndef _DMA_ENGINE_H_
+#define _DMA_ENGINE_H_
+
+/*
+Asynchronous driver for a Qsys DMA controller moving data from the DDR to an FPGA FIFO.
+
+Transfers are described by dma_descriptor_t and submitted to the engine queue. A worker thread
+programs the controller for each one in order, polls for its completion with a bounded timeout,
+fills in its status and timing, then calls its completion callback from the worker thread.
+
+The controller registers can also be a plain memory stand-in, for instance a file given as
+DEV_MEM on a host without FPGA: with DMA_EMULATED_RATE set, the engine raises DONE itself once
+the transfer would have taken length / rate seconds, so throughput and queueing can be benchmarked.
+*/
+
+#include "std_includes.h"
+
+typedef enum {
+	DMA_TRANSFER_QUEUED,
+	DMA_TRANSFER_DONE,
+	DMA_TRANSFER_TIMEOUT,
+	DMA_TRANSFER_ABORTED,
+} dma_transfer_status_t;
+
+typedef struct dma_descriptor dma_descriptor_t;
+
+//Called from the engine thread once a descriptor is done, timed out or aborted.
+typedef void (*dma_completion_t)(dma_descriptor_t* descriptor);
+
+struct dma_descriptor {
+	uint32_t source;		//physical address, as seen by the controller
+	uint32_t length;		//bytes
+	dma_completion_t completion;
+	void* context;
+
+	//filled by the engine
+	dma_transfer_status_t status;
+	long long submit_us;
+	long long start_us;
+	long long end_us;
+};
+
+typedef struct {
+	uint32_t transfers;
+	uint64_t bytes;
+	long long busy_us;			//time spent transferring
+	long long starved_us;		//time the controller waited for the next submit
+	long long max_transfer_us;
+	uint32_t timeouts;
+} dma_engine_stats_t;
+
+typedef struct {
+	const char* name;
+	void* regs;
+	double emulated_rate;		//bytes/s, 0 for real hardware
+	long long timeout_us;		//0 to wait forever
+
+	dma_descriptor_t** queue;
+	uint32_t queue_depth;
+	uint32_t queued;			//descriptors submitted
+	uint32_t completed;			//descriptors done, timed out or aborted
+	bool aborted;
+	bool stopping;
+	long long idle_since_us;
+	dma_engine_stats_t stats;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} dma_engine_t;
+
+//Resets the controller and starts the engine thread. At most queue_depth descriptors can be pending.
+bool dma_engine_init(dma_engine_t* engine, const char* name, void* regs, uint32_t queue_depth);
+
+//Aborts what is still pending and stops the engine thread.
+void dma_engine_destroy(dma_engine_t* engine);
+
+//Queues a transfer, waiting for room in the queue. Returns false if the engine has been aborted
+//or a previous transfer timed out, the descriptor is then not queued and marked DMA_TRANSFER_ABORTED.
+bool dma_engine_submit(dma_engine_t* engine, dma_descriptor_t* descriptor);
+
+//Number of submitted descriptors not completed yet, does not block.
+uint32_t dma_engine_poll(dma_engine_t* engine);
+
+//Waits until every submitted descriptor is completed.
+//Returns false if one of them timed out or was aborted.
+bool dma_engine_wait_idle(dma_engine_t* engine);
+
+//Stops the transfer in progress and drops the queued ones, which complete with DMA_TRANSFER_ABORTED.
+void dma_engine_abort(dma_engine_t* engine);
+
+void dma_engine_get_stats(dma_engine_t* engine, dma_engine_stats_t* stats);
+
+#endif
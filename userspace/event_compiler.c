@@ -0,0 +1,726 @@
+#include "event_compiler.h"
+#include "event_pack.h"
+#include "log.h"
+#include "common.h"
+
+void sequence_source_from_reserved(sequence_source_t* source, const void* reserved_base) {
+	const uint32_t* base_rams = (const uint32_t*)reserved_base;
+	for (int i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		source->rams[i] = base_rams + i * SEQUENCE_RAM_WORDS;
+	}
+	source->registers = base_rams + RAM_REGISTERS_INDEX * SEQUENCE_RAM_WORDS;
+	source->generation = 0;
+	source->structure_generation = 0;
+}
+
+bool event_compiler_reads_ram(uint32_t ram_id) {
+	switch (ram_id) {
+	case SEQ_RAM_FUNC:
+	case SEQ_RAM_TTL:
+	case SEQ_RAM_ORDERS:
+	case SEQ_RAM_SMART_TTL_ADR_ATT:
+	case SEQ_RAM_TIMER:
+	case SEQ_RAM_LOOP_PROGRAM:
+		return true;
+	}
+
+	for (uint32_t tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		if (ram_id == SEQ_RAM_ADR_C1 + tx || ram_id == SEQ_RAM_ADR_C1B + tx
+			|| ram_id == SEQ_RAM_TX_SHAPE_PARAM1 + tx || ram_id == SEQ_RAM_TX_SHAPE_PARAM1B + tx
+			|| ram_id == SEQ_RAM_TX_PHASE_SHAPE_PARAM1 + tx || ram_id == SEQ_RAM_TX_PHASE_SHAPE_PARAM1B + tx
+			|| ram_id == SEQ_RAM_FREQ1 + tx * SEQ_RAM_TX_STEP || ram_id == SEQ_RAM_PHASE1 + tx * SEQ_RAM_TX_STEP
+			|| ram_id == SEQ_RAM_AMP1 + tx * SEQ_RAM_TX_STEP) {
+			return true;
+		}
+	}
+
+	return ram_id >= SEQ_RAM_NB_OF_POINTS0 && ram_id < SEQ_RAM_NB_OF_POINTS0 + SEQ_NB_OF_POINTS;
+}
+
+bool event_compiler_reads_register(uint32_t index) {
+	return index == SEQ_REG_NB_DS || index == SEQ_REG_NB_PS
+		|| (index >= SEQ_REG_NB_1D && index < SEQ_REG_NB_1D + 4)
+		|| (index >= SEQ_REG_NB_ELEMENTS_1D && index < SEQ_REG_NB_ELEMENTS_1D + 4);
+}
+
+bool event_compiler_is_element_ram(uint32_t ram_id) {
+	if (ram_id == SEQ_RAM_TIMER) {
+		return true;
+	}
+
+	for (uint32_t tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		if (ram_id == SEQ_RAM_FREQ1 + tx * SEQ_RAM_TX_STEP || ram_id == SEQ_RAM_PHASE1 + tx * SEQ_RAM_TX_STEP
+			|| ram_id == SEQ_RAM_AMP1 + tx * SEQ_RAM_TX_STEP) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline event_lookup_t make_lookup(uint32_t base, uint32_t order) {
+	return (event_lookup_t) {
+		.base = base,
+		.order = order,
+	};
+}
+
+static void decode_row(const sequence_source_t* source, uint32_t i, event_row_t* row) {
+	const uint32_t* const* rams = source->rams;
+	uint32_t func = rams[SEQ_RAM_FUNC][i];
+	uint32_t orders = rams[SEQ_RAM_ORDERS][i];
+	uint32_t smart_ttl = rams[SEQ_RAM_SMART_TTL_ADR_ATT][i];
+
+	memset(row, 0, sizeof(event_row_t));
+	row->timer = make_lookup((func >> 22) & 0x3FF, (func >> 18) & 0xF);
+	row->words[1] = rams[SEQ_RAM_TTL][i];
+
+	for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		uint32_t adr = rams[SEQ_RAM_ADR_C1 + tx][i];
+		uint32_t adr_b = rams[SEQ_RAM_ADR_C1B + tx][i];
+		uint32_t* group = row->words + 2 + 4 * tx;
+
+		row->freq[tx] = make_lookup(adr & 0x3FF, (orders >> (4 * tx)) & 0xF);
+		row->phase[tx] = make_lookup(adr_b & 0x3FF, (orders >> 16) & 0xF);
+		row->amp[tx] = make_lookup((adr_b >> 11) & 0x3FF, (adr_b >> 22) & 0xF);
+
+		group[1] = ((smart_ttl >> (13 + tx)) & 0x1) << 29 | ((func >> (14 + tx)) & 0x1) << 28;
+		group[2] = (rams[SEQ_RAM_TX_SHAPE_PARAM1B + tx][i] & 0x7FFF) << 17 | (rams[SEQ_RAM_TX_SHAPE_PARAM1 + tx][i] & 0x1FFFF);
+		group[3] = (rams[SEQ_RAM_TX_PHASE_SHAPE_PARAM1B + tx][i] & 0x7FFF) << 17 | (rams[SEQ_RAM_TX_PHASE_SHAPE_PARAM1 + tx][i] & 0x1FFFF);
+	}
+	//phase reset only exists on TX1
+	row->words[3] |= ((func >> 6) & 0x1) << 30;
+
+	row->words[18] = 1 << 23 | (rams[SEQ_RAM_NB_OF_POINTS0][i] & 0x7FFFFF);
+	for (int p = 1; p < SEQ_NB_OF_POINTS; p++) {
+		row->words[18 + p] = rams[SEQ_RAM_NB_OF_POINTS0 + p][i];
+	}
+}
+
+//mask of the orders whose counter moves during the scan, the others always stay at 0
+static uint32_t moving_orders(const event_compiler_t* c) {
+	if (c->program.code != NULL) {
+		return c->program.orders;
+	}
+
+	uint32_t orders = 0;
+	for (int d = SCAN_1D; d <= SCAN_4D; d++) {
+		int order = ORDER_1D + d - SCAN_1D;
+		if (c->nb_dimensions[d] > 0 && c->nb_elements_per_counter[order] != 1) {
+			orders |= 1u << order;
+		}
+	}
+	return orders;
+}
+
+//finds the scanned TX, and packs the groups of each row with the elements at the base addresses,
+//which are the only ones a TX which is not scanned looks up
+static void pack_static_tx(event_compiler_t* c) {
+	uint32_t orders = moving_orders(c);
+	c->scanned_tx = 0;
+	for (uint32_t r = 0; r < c->nb_rows; r++) {
+		event_row_t* row = &c->rows[r];
+		for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+			uint32_t lookup_orders = 1u << row->freq[tx].order | 1u << row->phase[tx].order | 1u << row->amp[tx].order;
+			if (lookup_orders & orders) {
+				c->scanned_tx |= 1u << tx;
+			}
+			event_pack_group(row->words + 2 + EVENT_PACK_GROUP_WORDS * tx, c->freq[tx][row->freq[tx].base], c->amp[tx][row->amp[tx].base],
+				c->phase[tx][row->phase[tx].base], tx, row->tx_groups[tx]);
+		}
+	}
+	c->tx_variant = c->scanned_tx;
+	log_debug("Scanned TX 0x%x, moving orders 0x%x", c->scanned_tx, orders);
+}
+
+bool event_compiler_init(event_compiler_t* compiler, const sequence_source_t* source, event_stream_t stream) {
+	memset(compiler, 0, sizeof(event_compiler_t));
+	compiler->stream = stream;
+	compiler->generation = source->generation;
+	compiler->structure_generation = source->structure_generation;
+
+	//the sequence ends on the first func row with the end marker
+	const uint32_t* func = source->rams[SEQ_RAM_FUNC];
+	uint32_t nb_rows = 0;
+	while (nb_rows < SEQUENCE_RAM_WORDS && (func[nb_rows] & 0xff) != 0x08) {
+		nb_rows++;
+	}
+	if (nb_rows == SEQUENCE_RAM_WORDS) {
+		log_error("No end of sequence in func RAM");
+		return false;
+	}
+	nb_rows++;
+
+	compiler->rows = malloc(nb_rows * sizeof(event_row_t));
+	if (compiler->rows == NULL) {
+		log_error("Unable to allocate %u sequence rows", nb_rows);
+		return false;
+	}
+	compiler->nb_rows = nb_rows;
+	for (uint32_t i = 0; i < nb_rows; i++) {
+		decode_row(source, i, &compiler->rows[i]);
+	}
+
+	compiler->timer = source->rams[SEQ_RAM_TIMER];
+	for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		compiler->freq[tx] = source->rams[SEQ_RAM_FREQ1 + tx * SEQ_RAM_TX_STEP];
+		compiler->phase[tx] = source->rams[SEQ_RAM_PHASE1 + tx * SEQ_RAM_TX_STEP];
+		compiler->amp[tx] = source->rams[SEQ_RAM_AMP1 + tx * SEQ_RAM_TX_STEP];
+	}
+
+	const uint32_t* regs = source->registers;
+	compiler->nb_dimensions[SCAN_PS] = regs[SEQ_REG_NB_PS];
+	compiler->nb_dimensions[SCAN_DS] = regs[SEQ_REG_NB_DS];
+	compiler->nb_events = nb_rows;
+	for (int d = SCAN_1D; d <= SCAN_4D; d++) {
+		int order = ORDER_1D + d - SCAN_1D;
+		compiler->nb_dimensions[d] = regs[SEQ_REG_NB_1D + d - SCAN_1D];
+		compiler->nb_elements_per_counter[order] = 1 + regs[SEQ_REG_NB_ELEMENTS_1D + d - SCAN_1D];
+		compiler->nb_events *= (uint64_t)compiler->nb_dimensions[d] + 1;
+	}
+	compiler->nb_elements_per_counter[ORDER_0] = 1;
+
+	if (!event_program_load(&compiler->program, source->rams[SEQ_RAM_LOOP_PROGRAM], nb_rows)) {
+		event_compiler_destroy(compiler);
+		return false;
+	}
+	pack_static_tx(compiler);
+	if (compiler->program.code != NULL) {
+		compiler->nb_events = compiler->program.nb_events;
+		event_compiler_seek(compiler, 0);
+		log_info("Sequence of %u rows, loop program of %u words, %llu events",
+			nb_rows, compiler->program.nb_words, (unsigned long long)compiler->nb_events);
+		return true;
+	}
+
+	log_info("Sequence of %u rows, dimensions %u/%u/%u/%u, %llu events",
+		nb_rows, compiler->nb_dimensions[SCAN_1D], compiler->nb_dimensions[SCAN_2D],
+		compiler->nb_dimensions[SCAN_3D], compiler->nb_dimensions[SCAN_4D], (unsigned long long)compiler->nb_events);
+	return true;
+}
+
+bool event_compiler_specialize(event_compiler_t* compiler, uint32_t tx_variant) {
+	if ((tx_variant & ~SEQ_TX_ALL) != 0 || (compiler->scanned_tx & ~tx_variant) != 0) {
+		log_error("No compiler variant for TX 0x%x with TX 0x%x scanned", tx_variant, compiler->scanned_tx);
+		return false;
+	}
+	compiler->tx_variant = tx_variant;
+	return true;
+}
+
+void event_compiler_destroy(event_compiler_t* compiler) {
+	free(compiler->rows);
+	compiler->rows = NULL;
+	compiler->nb_rows = 0;
+}
+
+uint32_t event_compiler_event_words(const event_compiler_t* compiler) {
+	return compiler->stream == EVENT_STREAM_RF ? EVENT_RF_WORDS : EVENT_GRAD_WORDS;
+}
+
+static inline uint32_t lookup(const uint32_t* ram, event_lookup_t l, const uint32_t* modded) {
+	return ram[l.base + modded[l.order]];
+}
+
+//tx_variant is a constant in each fill variant, only the TX in it are looked up
+static inline void emit_rf_event(const event_compiler_t* c, const event_row_t* row, uint32_t* out, const uint32_t tx_variant) {
+	const uint32_t* modded = c->modded_scan_counters;
+
+	out[0] = lookup(c->timer, row->timer, modded);
+	out[1] = row->words[1];
+	if (tx_variant == SEQ_TX_ALL) {
+		uint32_t freq[SEQ_NB_OF_TX], amp[SEQ_NB_OF_TX], phase[SEQ_NB_OF_TX];
+		for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+			freq[tx] = lookup(c->freq[tx], row->freq[tx], modded);
+			amp[tx] = lookup(c->amp[tx], row->amp[tx], modded);
+			phase[tx] = lookup(c->phase[tx], row->phase[tx], modded);
+		}
+		event_pack_tx(row->words + 2, freq, amp, phase, out + 2);
+	}
+	else {
+		for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+			uint32_t* group = out + 2 + EVENT_PACK_GROUP_WORDS * tx;
+			if (tx_variant & (1u << tx)) {
+				event_pack_group(row->words + 2 + EVENT_PACK_GROUP_WORDS * tx, lookup(c->freq[tx], row->freq[tx], modded),
+					lookup(c->amp[tx], row->amp[tx], modded), lookup(c->phase[tx], row->phase[tx], modded), tx, group);
+			}
+			else {
+				memcpy(group, row->tx_groups[tx], sizeof(row->tx_groups[tx]));
+			}
+		}
+	}
+	for (int w = 18; w < 26; w++) {
+		out[w] = row->words[w];
+	}
+	for (int w = 26; w < EVENT_RF_WORDS; w++) {
+		out[w] = c->event_index;
+	}
+}
+
+static inline void emit_grad_event(const event_compiler_t* c, const event_row_t* row, uint32_t* out) {
+	out[0] = lookup(c->timer, row->timer, c->modded_scan_counters);
+	out[1] = row->words[1];
+	for (int w = 2; w < EVENT_GRAD_WORDS; w++) {
+		out[w] = 0;
+	}
+}
+
+//moves the scan counters to the next pass over the rows, innermost dimension first.
+//returns false after the last pass.
+static bool advance_pass(const event_compiler_t* c, uint32_t* scan_counters, uint32_t* current_counters) {
+	for (int d = SCAN_1D; d <= SCAN_4D; d++) {
+		int order = ORDER_1D + d - SCAN_1D;
+		if (scan_counters[d] < c->nb_dimensions[d]) {
+			scan_counters[d]++;
+			current_counters[order]++;
+			if (current_counters[order] == c->nb_elements_per_counter[order]) {
+				current_counters[order] = 0;
+			}
+			return true;
+		}
+		scan_counters[d] = 0;
+		current_counters[order] = 0;
+	}
+	return false;
+}
+
+//scan and element counters at the start of a pass, as advance_pass() leaves them
+static void pass_counters(const event_compiler_t* c, uint64_t pass, uint32_t* scan_counters, uint32_t* current_counters) {
+	memset(scan_counters, 0, SCAN_COUNTERS * sizeof(uint32_t));
+	memset(current_counters, 0, SEQ_NB_OF_ORDERS * sizeof(uint32_t));
+	for (int d = SCAN_1D; d <= SCAN_4D; d++) {
+		int order = ORDER_1D + d - SCAN_1D;
+		uint64_t radix = (uint64_t)c->nb_dimensions[d] + 1;
+		uint32_t nb_elements = c->nb_elements_per_counter[order];
+		scan_counters[d] = pass % radix;
+		current_counters[order] = nb_elements == 0 ? scan_counters[d] : scan_counters[d] % nb_elements;
+		pass /= radix;
+	}
+}
+
+//moves to the next EMIT of the loop program, row 0 looking up the counters it had last time
+static void next_emit(event_compiler_t* c) {
+	event_program_state_t* state = &c->program_state;
+	uint32_t first, count;
+	if (!event_program_next(&c->program, state, &first, &count)) {
+		c->done = true;
+		return;
+	}
+
+	c->row = first;
+	c->emit_end = first + count;
+	memcpy(c->modded_scan_counters, first == 0 ? state->lagged : state->counters, sizeof(c->modded_scan_counters));
+}
+
+//the program is run again from the start, only counting the events of the EMITs before the one of event
+static bool seek_program(event_compiler_t* c, uint64_t event) {
+	event_program_state_t* state = &c->program_state;
+	event_program_start(&c->program, state);
+	c->done = false;
+	c->event_index = event;
+
+	uint64_t remaining = event;
+	uint32_t first, count;
+	while (event_program_next(&c->program, state, &first, &count)) {
+		if (remaining < count) {
+			c->row = first + remaining;
+			c->emit_end = first + count;
+			if (first == 0 && remaining > 0) {
+				memcpy(state->lagged, state->counters, sizeof(state->lagged));
+			}
+			memcpy(c->modded_scan_counters, c->row == 0 ? state->lagged : state->counters, sizeof(c->modded_scan_counters));
+			return true;
+		}
+		if (first == 0) {
+			memcpy(state->lagged, state->counters, sizeof(state->lagged));
+		}
+		remaining -= count;
+	}
+
+	c->done = true;
+	return false;
+}
+
+bool event_compiler_seek(event_compiler_t* compiler, uint64_t event) {
+	if (event >= compiler->nb_events) {
+		compiler->done = true;
+		return false;
+	}
+	if (compiler->program.code != NULL) {
+		return seek_program(compiler, event);
+	}
+
+	uint64_t pass = event / compiler->nb_rows;
+	compiler->row = event % compiler->nb_rows;
+	compiler->event_index = event;
+	compiler->done = false;
+	pass_counters(compiler, pass, compiler->scan_counters, compiler->current_counters);
+
+	//see next_row(), the first row of a pass looks up with the counters of the previous one
+	if (compiler->row != 0) {
+		memcpy(compiler->modded_scan_counters, compiler->current_counters, sizeof(compiler->modded_scan_counters));
+	}
+	else if (pass > 0) {
+		uint32_t scan_counters[SCAN_COUNTERS];
+		pass_counters(compiler, pass - 1, scan_counters, compiler->modded_scan_counters);
+	}
+	else {
+		memset(compiler->modded_scan_counters, 0, sizeof(compiler->modded_scan_counters));
+	}
+	return true;
+}
+
+static void next_pass(event_compiler_t* c) {
+	if (!advance_pass(c, c->scan_counters, c->current_counters)) {
+		c->done = true;
+	}
+}
+
+static inline void next_program_row(event_compiler_t* c) {
+	if (c->row == 0) {
+		event_program_state_t* state = &c->program_state;
+		memcpy(state->lagged, state->counters, sizeof(state->lagged));
+		memcpy(c->modded_scan_counters, state->counters, sizeof(c->modded_scan_counters));
+	}
+	c->event_index++;
+	if (++c->row == c->emit_end) {
+		next_emit(c);
+	}
+}
+
+//The modded counters are only updated after an event has been emitted, so the first
+//row of a pass still uses the counters of the previous pass, as the FPGA expects.
+static inline void next_row(event_compiler_t* c) {
+	if (c->program.code != NULL) {
+		next_program_row(c);
+		return;
+	}
+	if (c->row == 0) {
+		memcpy(c->modded_scan_counters, c->current_counters, sizeof(c->modded_scan_counters));
+	}
+	if (++c->row == c->nb_rows) {
+		c->row = 0;
+		next_pass(c);
+	}
+	c->event_index++;
+}
+
+static inline uint32_t fill_rf(event_compiler_t* compiler, uint32_t* out, uint32_t max_events, const uint32_t tx_variant) {
+	uint32_t count = 0;
+
+	while (count < max_events && !compiler->done) {
+		emit_rf_event(compiler, &compiler->rows[compiler->row], out, tx_variant);
+		next_row(compiler);
+		out += EVENT_RF_WORDS;
+		count++;
+	}
+
+	return count;
+}
+
+static inline uint32_t fill_both(event_compiler_t* compiler, uint32_t* rf_out, uint32_t* grad_out, uint32_t max_events, const uint32_t tx_variant) {
+	uint32_t count = 0;
+
+	while (count < max_events && !compiler->done) {
+		emit_rf_event(compiler, &compiler->rows[compiler->row], rf_out, tx_variant);
+		//the gradient event is the timer and ttl words of the RF one
+		grad_out[0] = rf_out[0];
+		grad_out[1] = rf_out[1];
+		for (int w = 2; w < EVENT_GRAD_WORDS; w++) {
+			grad_out[w] = 0;
+		}
+		next_row(compiler);
+		rf_out += EVENT_RF_WORDS;
+		grad_out += EVENT_GRAD_WORDS;
+		count++;
+	}
+
+	return count;
+}
+
+//the fill loops of a set of TX, fill_rf_3 only looking up TX1 and TX2
+#define FILL_VARIANT(tx_variant) \
+	static uint32_t fill_rf_##tx_variant(event_compiler_t* compiler, uint32_t* out, uint32_t max_events) { \
+		return fill_rf(compiler, out, max_events, tx_variant); \
+	} \
+	static uint32_t fill_both_##tx_variant(event_compiler_t* compiler, uint32_t* rf_out, uint32_t* grad_out, uint32_t max_events) { \
+		return fill_both(compiler, rf_out, grad_out, max_events, tx_variant); \
+	}
+
+FILL_VARIANT(0)
+FILL_VARIANT(1)
+FILL_VARIANT(2)
+FILL_VARIANT(3)
+FILL_VARIANT(4)
+FILL_VARIANT(5)
+FILL_VARIANT(6)
+FILL_VARIANT(7)
+FILL_VARIANT(8)
+FILL_VARIANT(9)
+FILL_VARIANT(10)
+FILL_VARIANT(11)
+FILL_VARIANT(12)
+FILL_VARIANT(13)
+FILL_VARIANT(14)
+FILL_VARIANT(15)
+
+typedef struct {
+	uint32_t (*rf)(event_compiler_t* compiler, uint32_t* out, uint32_t max_events);
+	uint32_t (*both)(event_compiler_t* compiler, uint32_t* rf_out, uint32_t* grad_out, uint32_t max_events);
+} fill_variant_t;
+
+#define VARIANT(tx_variant) { fill_rf_##tx_variant, fill_both_##tx_variant }
+
+//indexed by the mask of the TX looked up
+static const fill_variant_t fill_variants[SEQ_TX_ALL + 1] = {
+	VARIANT(0), VARIANT(1), VARIANT(2), VARIANT(3), VARIANT(4), VARIANT(5), VARIANT(6), VARIANT(7),
+	VARIANT(8), VARIANT(9), VARIANT(10), VARIANT(11), VARIANT(12), VARIANT(13), VARIANT(14), VARIANT(15),
+};
+
+uint32_t event_compiler_fill(event_compiler_t* compiler, uint32_t* out, uint32_t max_events) {
+	if (compiler->stream == EVENT_STREAM_RF) {
+		return fill_variants[compiler->tx_variant].rf(compiler, out, max_events);
+	}
+
+	uint32_t count = 0;
+	while (count < max_events && !compiler->done) {
+		emit_grad_event(compiler, &compiler->rows[compiler->row], out);
+		next_row(compiler);
+		out += EVENT_GRAD_WORDS;
+		count++;
+	}
+	return count;
+}
+
+uint32_t event_compiler_fill_both(event_compiler_t* compiler, uint32_t* rf_out, uint32_t* grad_out, uint32_t max_events) {
+	return fill_variants[compiler->tx_variant].both(compiler, rf_out, grad_out, max_events);
+}
+
+//in the second word of the group of a TX
+#define EVENT_TX_GATE (1u << 28)
+
+void event_compiler_analyze(const event_compiler_t* compiler, event_analytics_t* analytics) {
+	memset(analytics, 0, sizeof(event_analytics_t));
+	analytics->generation = compiler->generation;
+
+	//a copy shares the rows, and only the timer and amplitudes are looked up
+	event_compiler_t c = *compiler;
+	if (!event_compiler_seek(&c, 0)) {
+		return;
+	}
+	while (!c.done) {
+		const event_row_t* row = &c.rows[c.row];
+		const uint32_t* modded = c.modded_scan_counters;
+		uint32_t timer = lookup(c.timer, row->timer, modded);
+		analytics->duration += timer;
+		if (row->words[1] != 0) {
+			analytics->ttl_on += timer;
+		}
+		for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+			if (row->words[3 + 4 * tx] & EVENT_TX_GATE) {
+				double amp = (lookup(c.amp[tx], row->amp[tx], modded) & event_amp_masks[tx]) / (double)event_amp_masks[tx];
+				analytics->tx_on[tx] += timer;
+				analytics->tx_energy[tx] += timer * amp * amp;
+			}
+		}
+		next_row(&c);
+		analytics->nb_events++;
+	}
+}
+
+//the element RAM lookups of a row, in the order of EVENT_ELEMENT_RAMS
+static event_lookup_t element_lookup(const event_row_t* row, int element) {
+	if (element == 0) {
+		return row->timer;
+	}
+	element--;
+	if (element < SEQ_NB_OF_TX) {
+		return row->freq[element];
+	}
+	element -= SEQ_NB_OF_TX;
+	if (element < SEQ_NB_OF_TX) {
+		return row->phase[element];
+	}
+	return row->amp[element - SEQ_NB_OF_TX];
+}
+
+static const uint32_t* element_ram(const event_compiler_t* c, int element) {
+	if (element == 0) {
+		return c->timer;
+	}
+	element--;
+	if (element < SEQ_NB_OF_TX) {
+		return c->freq[element];
+	}
+	element -= SEQ_NB_OF_TX;
+	if (element < SEQ_NB_OF_TX) {
+		return c->phase[element];
+	}
+	return c->amp[element - SEQ_NB_OF_TX];
+}
+
+//number of consecutive addresses a lookup goes through during the scan
+static inline uint32_t reachable_elements(const event_compiler_t* c, event_lookup_t l) {
+	uint32_t nb_elements = c->nb_elements_per_counter[l.order];
+	if (nb_elements == 0 && l.order >= ORDER_1D && l.order <= ORDER_4D) {
+		//no elements, see pass_counters(): the counter is the scan counter of its dimension
+		uint64_t nb_steps = (uint64_t)c->nb_dimensions[SCAN_1D + l.order - ORDER_1D] + 1;
+		return (uint32_t)MINIMUM(nb_steps, SEQUENCE_RAM_WORDS);
+	}
+	//orders above the 4D one are never incremented
+	return MAXIMUM(nb_elements, 1);
+}
+
+bool event_patch_init(event_patch_t* patch, const event_compiler_t* compiler, event_stream_t stream) {
+	memset(patch, 0, sizeof(event_patch_t));
+	if (compiler->program.code != NULL) {
+		return false;
+	}
+	patch->compiler = *compiler;
+	patch->compiler.stream = stream;
+
+	patch->compiler.rows = malloc(compiler->nb_rows * sizeof(event_row_t));
+	if (patch->compiler.rows == NULL) {
+		log_error("Unable to allocate %u sequence rows", compiler->nb_rows);
+		return false;
+	}
+	memcpy(patch->compiler.rows, compiler->rows, compiler->nb_rows * sizeof(event_row_t));
+
+	for (int e = 0; e < EVENT_ELEMENT_RAMS; e++) {
+		uint32_t words = 0;
+		for (uint32_t r = 0; r < compiler->nb_rows; r++) {
+			event_lookup_t l = element_lookup(&compiler->rows[r], e);
+			words = MAXIMUM(words, l.base + reachable_elements(compiler, l));
+		}
+		words = MINIMUM(words, SEQUENCE_RAM_WORDS);
+
+		patch->snapshots[e] = malloc(words * sizeof(uint32_t));
+		if (patch->snapshots[e] == NULL) {
+			log_error("Unable to allocate snapshot of %u elements", words);
+			event_patch_destroy(patch);
+			return false;
+		}
+		memcpy(patch->snapshots[e], element_ram(compiler, e), words * sizeof(uint32_t));
+		patch->snapshot_words[e] = words;
+	}
+	return true;
+}
+
+void event_patch_destroy(event_patch_t* patch) {
+	event_compiler_destroy(&patch->compiler);
+	for (int e = 0; e < EVENT_ELEMENT_RAMS; e++) {
+		free(patch->snapshots[e]);
+		patch->snapshots[e] = NULL;
+	}
+}
+
+//a row looking up an element ram, at an address which changed for at least one pass
+typedef struct {
+	uint32_t row;
+	int element;
+	event_lookup_t lookup;
+} patch_ref_t;
+
+bool event_patch_apply(event_patch_t* patch, const event_compiler_t* compiler, uint32_t* events, uint64_t* nb_words) {
+	event_compiler_t* c = &patch->compiler;
+	bool rf = c->stream == EVENT_STREAM_RF;
+	uint32_t event_words = event_compiler_event_words(c);
+	//the gradient events only hold the timer
+	int nb_elements = rf ? EVENT_ELEMENT_RAMS : 1;
+
+	//changed addresses, and the new values taken as the snapshot
+	uint8_t* changed[EVENT_ELEMENT_RAMS] = { NULL };
+	bool any_change = false;
+	bool success = true;
+	for (int e = 0; success && e < nb_elements; e++) {
+		const uint32_t* ram = element_ram(compiler, e);
+		if (memcmp(patch->snapshots[e], ram, patch->snapshot_words[e] * sizeof(uint32_t)) == 0) {
+			continue;
+		}
+
+		changed[e] = calloc(patch->snapshot_words[e], 1);
+		if (changed[e] == NULL) {
+			log_error("Unable to allocate changed elements");
+			success = false;
+			break;
+		}
+		for (uint32_t a = 0; a < patch->snapshot_words[e]; a++) {
+			changed[e][a] = patch->snapshots[e][a] != ram[a];
+		}
+		memcpy(patch->snapshots[e], ram, patch->snapshot_words[e] * sizeof(uint32_t));
+		any_change = true;
+	}
+
+	//rows whose lookup range holds a changed address
+	patch_ref_t* refs = NULL;
+	uint32_t nb_refs = 0;
+	if (success && any_change) {
+		refs = malloc(c->nb_rows * nb_elements * sizeof(patch_ref_t));
+		if (refs == NULL) {
+			log_error("Unable to allocate %u patch references", c->nb_rows * nb_elements);
+			success = false;
+		}
+	}
+	for (uint32_t r = 0; refs != NULL && r < c->nb_rows; r++) {
+		for (int e = 0; e < nb_elements; e++) {
+			if (changed[e] == NULL) {
+				continue;
+			}
+			event_lookup_t l = element_lookup(&c->rows[r], e);
+			uint32_t end = MINIMUM(l.base + reachable_elements(c, l), patch->snapshot_words[e]);
+			for (uint32_t a = l.base; a < end; a++) {
+				if (changed[e][a]) {
+					refs[nb_refs++] = (patch_ref_t) { .row = r, .element = e, .lookup = l };
+					break;
+				}
+			}
+		}
+	}
+
+	//walk the scan again, only the referenced words are rewritten
+	*nb_words = 0;
+	uint32_t scan_counters[SCAN_COUNTERS] = { 0 };
+	uint32_t current[SEQ_NB_OF_ORDERS] = { 0 };
+	uint32_t previous[SEQ_NB_OF_ORDERS] = { 0 };
+	uint64_t pass = 0;
+	bool more = nb_refs > 0;
+	while (more) {
+		for (uint32_t i = 0; i < nb_refs; i++) {
+			patch_ref_t* ref = &refs[i];
+			//the first row of a pass still uses the counters of the previous pass
+			const uint32_t* modded = ref->row == 0 ? previous : current;
+			uint32_t address = ref->lookup.base + modded[ref->lookup.order];
+			if (address >= patch->snapshot_words[ref->element] || !changed[ref->element][address]) {
+				continue;
+			}
+
+			const event_row_t* row = &c->rows[ref->row];
+			uint32_t* out = events + (pass * c->nb_rows + ref->row) * event_words;
+			int element = ref->element;
+			if (element == 0) {
+				out[0] = lookup(compiler->timer, row->timer, modded);
+			}
+			else if (element <= SEQ_NB_OF_TX) {
+				int tx = element - 1;
+				out[2 + 4 * tx] = lookup(compiler->freq[tx], row->freq[tx], modded);
+			}
+			else {
+				//phase and amp share a word
+				int tx = (element - 1) % SEQ_NB_OF_TX;
+				out[3 + 4 * tx] = row->words[3 + 4 * tx]
+					| (lookup(compiler->amp[tx], row->amp[tx], modded) & event_amp_masks[tx]) << 16
+					| (lookup(compiler->phase[tx], row->phase[tx], modded) & 0xffff);
+			}
+			(*nb_words)++;
+		}
+
+		memcpy(previous, current, sizeof(previous));
+		more = advance_pass(c, scan_counters, current);
+		pass++;
+	}
+
+	free(refs);
+	for (int e = 0; e < nb_elements; e++) {
+		free(changed[e]);
+	}
+	return success;
+}
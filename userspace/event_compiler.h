@@ -0,0 +1,227 @@
+#ifndef _EVENT_COMPILER_H_
+#define _EVENT_COMPILER_H_
+
+/*
+Sequence event compiler, shared by the RF/RX and gradient event streams.
+
+The func RAM and all the RAMs indexed like it (ttl, orders, addresses, shapes, nb of points)
+are decoded once into a table of rows. Each row keeps the event words which do not depend
+on the scan, and the base address + order of every element lookup (timer, freq, phase, amp).
+Emitting an event is then copying the row template and resolving those few lookups
+against the modded scan counters, which are advanced incrementally instead of using modulos.
+
+The compiler is a generator: event_compiler_fill() can be called repeatedly to get the
+events in chunks, which is how they are fed to the FPGA DMA. Both streams come from the same
+rows and scan, so event_compiler_fill_both() emits them together in a single pass.
+
+Most sequences only scan the elements of one or two TX channels. The groups of the other channels
+are the same in every event of a row, they are packed once per row. The fill loops are instantiated
+for each set of scanned channels, the variant of the sequence only looking up and packing those.
+
+When the loop program RAM holds a program (see event_program.h), it gives the order of the passes
+over the rows instead of the fixed nest of the 1D to 4D scan dimensions.
+
+Since element values only flow into a few words of each event, an event_patch_t kept with a
+compiled stream is a reverse index from each element RAM to the rows looking it up, and the range
+of addresses they can reach. When only element values change, the scan is walked again and just
+the words of the events looking up a changed address are rewritten.
+*/
+
+#include "std_includes.h"
+#include "memory_map.h"
+#include "event_program.h"
+
+//number of 32 bits words in each sequence RAM
+#define SEQUENCE_RAM_WORDS              (RAM_OFFSET_STEP / 4)
+//sequence RAM ids go up to the last TX address RAM, then the loop program
+#define SEQUENCE_RAM_SLOTS              116
+
+//event RAMs, one word per row
+#define SEQ_RAM_FUNC                    0
+#define SEQ_RAM_TTL                     1
+#define SEQ_RAM_ORDERS                  3
+#define SEQ_RAM_ADR_C1                  4
+#define SEQ_RAM_TX_SHAPE_PARAM1         8
+#define SEQ_RAM_NB_OF_POINTS0           41
+#define SEQ_RAM_TX_PHASE_SHAPE_PARAM1   74
+#define SEQ_RAM_SMART_TTL_ADR_ATT       90
+#define SEQ_RAM_TX_SHAPE_PARAM1B        95
+#define SEQ_RAM_TX_PHASE_SHAPE_PARAM1B  103
+#define SEQ_RAM_ADR_C1B                 111
+#define SEQ_RAM_LOOP_PROGRAM            115	//written by the host as RAM_DDR_LOOP_PROGRAM
+
+//element RAMs, indexed by base address + modded scan counter
+#define SEQ_RAM_FREQ1                   25
+#define SEQ_RAM_PHASE1                  26
+#define SEQ_RAM_AMP1                    27
+#define SEQ_RAM_TX_STEP                 4	//distance between the RAMs of two TX channels
+#define SEQ_RAM_TIMER                   49
+
+#define SEQ_NB_OF_TX                    4
+#define SEQ_TX_ALL                      ((1u << SEQ_NB_OF_TX) - 1)
+#define SEQ_NB_OF_POINTS                8
+#define SEQ_NB_OF_ORDERS                16
+
+//words in the sequence registers RAM (RAM_REGISTERS_INDEX)
+#define SEQ_REG_NB_DS                   7
+#define SEQ_REG_NB_1D                   8
+#define SEQ_REG_NB_ELEMENTS_1D          12
+#define SEQ_REG_NB_PS                   93
+
+//scan counters
+#define SCAN_PS                         0
+#define SCAN_DS                         1
+#define SCAN_1D                         2
+#define SCAN_2D                         3
+#define SCAN_3D                         4
+#define SCAN_4D                         5
+#define SCAN_COUNTERS                   6
+
+//orders, indexes of the modded scan counters
+#define ORDER_0                         0
+#define ORDER_1D                        1
+#define ORDER_4D                        4
+
+#define EVENT_RF_WORDS                  32
+#define EVENT_RF_BYTES                  (EVENT_RF_WORDS * 4)
+#define EVENT_GRAD_WORDS                16
+#define EVENT_GRAD_BYTES                (EVENT_GRAD_WORDS * 4)
+
+//timer, then freq, phase and amp of each TX
+#define EVENT_ELEMENT_RAMS              (1 + 3 * SEQ_NB_OF_TX)
+
+typedef enum {
+	EVENT_STREAM_RF,
+	EVENT_STREAM_GRAD,
+} event_stream_t;
+
+//Where the compiler reads the sequence RAMs from, one pointer per RAM id.
+typedef struct {
+	const uint32_t* rams[SEQUENCE_RAM_SLOTS];
+	const uint32_t* registers;
+	uint64_t generation;	//changes whenever a RAM or register read by the compiler changes, 0 if unknown
+	uint64_t structure_generation;	//same, leaving out the element RAMs
+} sequence_source_t;
+
+//An element RAM lookup: ram[base + modded_scan_counters[order]]
+typedef struct {
+	uint16_t base;
+	uint16_t order;
+} event_lookup_t;
+
+//A func RAM row, decoded once per compilation.
+typedef struct {
+	uint32_t words[EVENT_RF_WORDS];	//scan independent words, 0 where a lookup is or'ed in
+	event_lookup_t timer;
+	event_lookup_t freq[SEQ_NB_OF_TX];
+	event_lookup_t phase[SEQ_NB_OF_TX];
+	event_lookup_t amp[SEQ_NB_OF_TX];
+	uint32_t tx_groups[SEQ_NB_OF_TX][4];	//packed words 2-17, for the TX left out of the variant
+} event_row_t;
+
+typedef struct {
+	event_stream_t stream;
+	uint64_t generation;	//of the source
+	uint64_t structure_generation;
+
+	const uint32_t* timer;
+	const uint32_t* freq[SEQ_NB_OF_TX];
+	const uint32_t* phase[SEQ_NB_OF_TX];
+	const uint32_t* amp[SEQ_NB_OF_TX];
+
+	event_row_t* rows;
+	uint32_t nb_rows;
+
+	uint32_t nb_dimensions[SCAN_COUNTERS];
+	uint32_t nb_elements_per_counter[SEQ_NB_OF_ORDERS];
+	uint64_t nb_events;
+	event_program_t program;	//no code for the fixed nest
+	uint32_t scanned_tx;	//mask of the TX with an element looked up with a moving counter
+	uint32_t tx_variant;	//mask of the TX the fill loops look up, the others are copied from tx_groups
+
+	//generator state
+	uint32_t scan_counters[SCAN_COUNTERS];
+	uint32_t current_counters[SEQ_NB_OF_ORDERS];
+	uint32_t modded_scan_counters[SEQ_NB_OF_ORDERS];
+	uint32_t row;
+	uint32_t event_index;
+	bool done;
+	event_program_state_t program_state;
+	uint32_t emit_end;		//row after the last one of the program EMIT in progress
+} event_compiler_t;
+
+//Points every RAM of the source at its place in the reserved DDR (ram id * RAM_OFFSET_STEP).
+void sequence_source_from_reserved(sequence_source_t* source, const void* reserved_base);
+
+//True for the RAMs the compiler reads, apart from the registers.
+bool event_compiler_reads_ram(uint32_t ram_id);
+
+//True for the words of the registers RAM the compiler reads.
+bool event_compiler_reads_register(uint32_t index);
+
+//True for the element RAMs: timer, freq, phase and amp.
+//Their values are only looked up, changing them does not change the structure of the events.
+bool event_compiler_is_element_ram(uint32_t ram_id);
+
+//Decodes the func RAM rows and reads the scan dimensions.
+//Returns false if the sequence has no end marker.
+bool event_compiler_init(event_compiler_t* compiler, const sequence_source_t* source, event_stream_t stream);
+
+//Sets the TX the fill loops look up and pack, which must include the scanned ones.
+//event_compiler_init() picks the variant of the scanned TX, SEQ_TX_ALL is the generic compiler.
+//Returns false if a scanned TX is left out.
+bool event_compiler_specialize(event_compiler_t* compiler, uint32_t tx_variant);
+
+//Releases the decoded rows.
+void event_compiler_destroy(event_compiler_t* compiler);
+
+//Number of 32 bits words of one event of the compiler stream.
+uint32_t event_compiler_event_words(const event_compiler_t* compiler);
+
+//Moves the compiler to the given event, the next fill starts there. A copy of a compiler shares its rows,
+//so several copies seeked to different events can compile ranges of the same sequence in parallel.
+//Returns false, the compiler being done, past the last event.
+bool event_compiler_seek(event_compiler_t* compiler, uint64_t event);
+
+//Writes up to max_events consecutive events to out.
+//Returns the number of events written, 0 once the whole sequence has been compiled.
+uint32_t event_compiler_fill(event_compiler_t* compiler, uint32_t* out, uint32_t max_events);
+
+//Values of the element RAMs a compiled stream was built from, with the rows that look them up,
+//so the stream can be patched in place when only element values change.
+typedef struct {
+	event_compiler_t compiler;	//rows and scan of the compiled stream
+	uint32_t* snapshots[EVENT_ELEMENT_RAMS];
+	uint32_t snapshot_words[EVENT_ELEMENT_RAMS];	//highest address any row can look up, + 1
+} event_patch_t;
+
+//Same as event_compiler_fill(), but walks the rows once for both streams:
+//each event is written as an RF event to rf_out and as a gradient event to grad_out.
+uint32_t event_compiler_fill_both(event_compiler_t* compiler, uint32_t* rf_out, uint32_t* grad_out, uint32_t max_events);
+
+//What a sequence asks of the hardware, from a walk of its events which does not emit them.
+//Times are in ticks of the sequence timer.
+typedef struct {
+	uint64_t generation;				//of the source of the compiler
+	uint64_t nb_events;
+	uint64_t duration;					//sum of the timers
+	uint64_t tx_on[SEQ_NB_OF_TX];		//time with the TX gate set
+	double tx_energy[SEQ_NB_OF_TX];		//time with the gate set x (amplitude / full scale)^2
+	uint64_t ttl_on;					//time with a TTL output set, the gradient stream only holds the timer and TTLs
+} event_analytics_t;
+
+//Walks every event of the compiler to fill analytics, the compiler itself is left where it was.
+void event_compiler_analyze(const event_compiler_t* compiler, event_analytics_t* analytics);
+
+//Keeps the rows of a compiler which has just compiled a whole stream of events, and the element values it used.
+//The stream can differ from the one of the compiler when both were compiled at once.
+//Returns false for a loop program, the patch only knows the fixed nest.
+bool event_patch_init(event_patch_t* patch, const event_compiler_t* compiler, event_stream_t stream);
+void event_patch_destroy(event_patch_t* patch);
+
+//Rewrites, in the events compiled with the patch, the words looking up an element which changed
+//in the RAMs of the compiler. The compiler must have the same structure generation as the patch.
+//Returns false if the patch could not be applied entirely, the events must then be compiled again.
+bool event_patch_apply(event_patch_t* patch, const event_compiler_t* compiler, uint32_t* events, uint64_t* nb_words);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _EVENT_PACK_H_
+#define _EVENT_PACK_H_
+
+/*
+Packing of the four TX groups of an RF event (words 2-17), the innermost loop of the compiler.
+
+Each group is 4 words:
+	freq
+	enable/sw_att template | (amp & amp mask) << 16 | (phase & 0xffff)
+	shape params
+	phase shape params
+The element values are looked up by the caller. On ARM the four channels are packed at once with
+NEON: the row template is de-interleaved per word with vld4q, and the groups interleaved back with vst4q.
+event_pack_tx_scalar() is the portable version, also kept on ARM to compare against.
+event_pack_group() packs one channel, for the compiler variants leaving out the others.
+*/
+
+#include "std_includes.h"
+#include "event_compiler.h"
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#define EVENT_PACK_GROUP_WORDS	4
+#define EVENT_PACK_WORDS		(EVENT_PACK_GROUP_WORDS * SEQ_NB_OF_TX)
+
+//TX1 amplitude is 12 bits
+static const uint32_t event_amp_masks[SEQ_NB_OF_TX] = { 0xfff, 0xffff, 0xffff, 0xffff };
+
+//the group of a single TX, template being the scan independent words of the group
+static inline void event_pack_group(const uint32_t* template, uint32_t freq, uint32_t amp, uint32_t phase, int tx, uint32_t* group) {
+	group[0] = freq;
+	group[1] = template[1] | (amp & event_amp_masks[tx]) << 16 | (phase & 0xffff);
+	group[2] = template[2];
+	group[3] = template[3];
+}
+
+//template: the EVENT_PACK_WORDS scan independent words of the row, freq/amp/phase: looked up values of each TX
+static inline void event_pack_tx_scalar(const uint32_t* template, const uint32_t* freq, const uint32_t* amp, const uint32_t* phase, uint32_t* out) {
+	for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+		event_pack_group(template + EVENT_PACK_GROUP_WORDS * tx, freq[tx], amp[tx], phase[tx], tx, out + EVENT_PACK_GROUP_WORDS * tx);
+	}
+}
+
+#ifdef __ARM_NEON
+#define EVENT_PACK_KERNEL "neon"
+
+static inline void event_pack_tx(const uint32_t* template, const uint32_t* freq, const uint32_t* amp, const uint32_t* phase, uint32_t* out) {
+	//val[k] holds word k of the four groups
+	uint32x4x4_t groups = vld4q_u32(template);
+	uint32x4_t amps = vshlq_n_u32(vandq_u32(vld1q_u32(amp), vld1q_u32(event_amp_masks)), 16);
+	uint32x4_t phases = vandq_u32(vld1q_u32(phase), vdupq_n_u32(0xffff));
+
+	groups.val[0] = vld1q_u32(freq);
+	groups.val[1] = vorrq_u32(groups.val[1], vorrq_u32(amps, phases));
+	vst4q_u32(out, groups);
+}
+#else
+#define EVENT_PACK_KERNEL "scalar"
+
+static inline void event_pack_tx(const uint32_t* template, const uint32_t* freq, const uint32_t* amp, const uint32_t* phase, uint32_t* out) {
+	event_pack_tx_scalar(template, freq, amp, phase, out);
+}
+#endif
+
+#endif
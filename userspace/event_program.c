@@ -0,0 +1,234 @@
+#include "event_program.h"
+#include "event_compiler.h"
+#include "log.h"
+#include "common.h"
+
+//words of the header before the instructions
+#define PROGRAM_HEADER_WORDS 2
+#define PROGRAM_MAX_WORDS (SEQUENCE_RAM_WORDS - PROGRAM_HEADER_WORDS)
+//instructions run to count the events, past which a program is too long
+#define PROGRAM_MAX_STEPS (1u << 28)
+
+static inline uint32_t opcode(uint32_t word) {
+	return word >> 24;
+}
+
+static inline uint32_t argument(uint32_t word) {
+	return word & 0xFFFFFF;
+}
+
+//words of an instruction with its operands, 0 for an unknown opcode
+static uint32_t instruction_words(uint32_t op) {
+	switch (op) {
+	case EVENT_OP_END:
+	case EVENT_OP_NEXT:
+		return 1;
+	case EVENT_OP_EMIT:
+	case EVENT_OP_JUMP:
+		return 2;
+	case EVENT_OP_LOOP:
+	case EVENT_OP_BRANCH:
+		return 3;
+	}
+	return 0;
+}
+
+//blocks gets the pc of the loop each instruction is in, nb_words outside of any loop:
+//a jump must stay in the loop body it is in.
+static bool check_program(const uint32_t* code, uint32_t nb_words, uint32_t nb_rows, uint32_t* blocks) {
+	uint32_t loops[EVENT_PROGRAM_DEPTH];
+	uint32_t depth = 0;
+	uint32_t pc = 0;
+
+	for (uint32_t i = 0; i <= nb_words; i++) {
+		blocks[i] = UINT32_MAX;
+	}
+	while (pc < nb_words) {
+		uint32_t op = opcode(code[pc]);
+		uint32_t arg = argument(code[pc]);
+		uint32_t words = instruction_words(op);
+		if (words == 0 || pc + words > nb_words) {
+			log_error("Loop program: invalid instruction 0x%x at %u", code[pc], pc);
+			return false;
+		}
+		blocks[pc] = depth > 0 ? loops[depth - 1] : nb_words;
+
+		switch (op) {
+		case EVENT_OP_EMIT:
+			if (code[pc + 1] == 0 || arg >= nb_rows || code[pc + 1] > nb_rows - arg) {
+				log_error("Loop program: rows %u to %u emitted at %u, the sequence has %u rows", arg, arg + code[pc + 1], pc, nb_rows);
+				return false;
+			}
+			break;
+		case EVENT_OP_LOOP:
+			if (depth == EVENT_PROGRAM_DEPTH || code[pc + 1] == 0 || (arg & ~0xFFFEu) != 0) {
+				log_error("Loop program: invalid loop at %u, orders 0x%x, %u iterations", pc, arg, code[pc + 1]);
+				return false;
+			}
+			loops[depth++] = pc;
+			break;
+		case EVENT_OP_NEXT:
+			if (depth == 0) {
+				log_error("Loop program: next without a loop at %u", pc);
+				return false;
+			}
+			depth--;
+			break;
+		case EVENT_OP_BRANCH:
+			if (arg >= depth) {
+				log_error("Loop program: branch on loop level %u at %u, in %u loops", arg, pc, depth);
+				return false;
+			}
+			break;
+		}
+		pc += words;
+	}
+	if (depth != 0) {
+		log_error("Loop program: %u loops without next", depth);
+		return false;
+	}
+	//jumping to the end is leaving the program
+	blocks[nb_words] = nb_words;
+
+	for (pc = 0; pc < nb_words; pc += instruction_words(opcode(code[pc]))) {
+		uint32_t op = opcode(code[pc]);
+		if (op != EVENT_OP_BRANCH && op != EVENT_OP_JUMP) {
+			continue;
+		}
+
+		uint32_t target = code[pc + instruction_words(op) - 1];
+		if (target <= pc || target > nb_words || blocks[target] != blocks[pc]) {
+			log_error("Loop program: jump from %u to %u out of its loop or backwards", pc, target);
+			return false;
+		}
+	}
+	return true;
+}
+
+void event_program_start(const event_program_t* program, event_program_state_t* state) {
+	memset(state, 0, sizeof(event_program_state_t));
+}
+
+//sets the counters of the orders of a loop to their element at iteration
+static void set_counters(event_program_state_t* state, uint32_t orders, uint32_t nb_elements, uint32_t iteration) {
+	for (int order = 1; order < EVENT_PROGRAM_ORDERS; order++) {
+		if (orders & (1u << order)) {
+			state->counters[order] = nb_elements == 0 ? iteration : iteration % nb_elements;
+		}
+	}
+}
+
+//runs up to the next EMIT, or until *steps instructions were run when steps isn't NULL
+static bool run(const event_program_t* program, event_program_state_t* state, uint32_t* first_row, uint32_t* nb_rows, uint32_t* steps) {
+	const uint32_t* code = program->code;
+	while (state->pc < program->nb_words) {
+		if (steps != NULL && (*steps)-- == 0) {
+			*steps = 0;
+			return false;
+		}
+		uint32_t pc = state->pc;
+		uint32_t op = opcode(code[pc]);
+		state->pc += instruction_words(op);
+
+		switch (op) {
+		case EVENT_OP_END:
+			state->pc = program->nb_words;
+			return false;
+		case EVENT_OP_EMIT:
+			*first_row = argument(code[pc]);
+			*nb_rows = code[pc + 1];
+			return true;
+		case EVENT_OP_LOOP:
+			state->loops[state->depth] = pc;
+			state->iterations[state->depth] = 0;
+			state->depth++;
+			set_counters(state, argument(code[pc]), code[pc + 2], 0);
+			break;
+		case EVENT_OP_NEXT: {
+			uint32_t level = state->depth - 1;
+			uint32_t loop = state->loops[level];
+			uint32_t iteration = ++state->iterations[level];
+			if (iteration < code[loop + 1]) {
+				set_counters(state, argument(code[loop]), code[loop + 2], iteration);
+				state->pc = loop + instruction_words(EVENT_OP_LOOP);
+			}
+			else {
+				set_counters(state, argument(code[loop]), code[loop + 2], 0);
+				state->depth--;
+			}
+			break;
+		}
+		case EVENT_OP_BRANCH:
+			if (state->iterations[state->depth - 1 - argument(code[pc])] == code[pc + 1]) {
+				state->pc = code[pc + 2];
+			}
+			break;
+		case EVENT_OP_JUMP:
+			state->pc = code[pc + 1];
+			break;
+		}
+	}
+	return false;
+}
+
+bool event_program_load(event_program_t* program, const uint32_t* ram, uint32_t nb_rows) {
+	memset(program, 0, sizeof(event_program_t));
+	if (ram[0] != EVENT_PROGRAM_MAGIC) {
+		return true;
+	}
+
+	uint32_t nb_words = ram[1];
+	if (nb_words > PROGRAM_MAX_WORDS) {
+		log_error("Loop program of %u words, at most %u", nb_words, PROGRAM_MAX_WORDS);
+		return false;
+	}
+
+	const uint32_t* code = ram + PROGRAM_HEADER_WORDS;
+	uint32_t* blocks = malloc((nb_words + 1) * sizeof(uint32_t));
+	if (blocks == NULL) {
+		log_error("Unable to allocate loop program blocks");
+		return false;
+	}
+	bool valid = check_program(code, nb_words, nb_rows, blocks);
+	free(blocks);
+	if (!valid) {
+		return false;
+	}
+
+	program->code = code;
+	program->nb_words = nb_words;
+	for (uint32_t pc = 0; pc < nb_words; pc += instruction_words(opcode(code[pc]))) {
+		if (opcode(code[pc]) == EVENT_OP_LOOP) {
+			program->orders |= argument(code[pc]);
+		}
+	}
+
+	//jumps only go forward, running it once always ends
+	event_program_state_t state;
+	uint32_t first_row, count;
+	uint32_t steps = PROGRAM_MAX_STEPS;
+	event_program_start(program, &state);
+	while (run(program, &state, &first_row, &count, &steps)) {
+		program->nb_events += count;
+	}
+	if (steps == 0) {
+		log_error("Loop program too long, more than %u instructions to run", PROGRAM_MAX_STEPS);
+		program->code = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool event_program_complete(const void* data, uint32_t nbytes) {
+	const uint32_t* ram = data;
+	if (nbytes < sizeof(uint32_t) || ram[0] != EVENT_PROGRAM_MAGIC) {
+		return true;
+	}
+
+	uint32_t nb_words = nbytes / sizeof(uint32_t);
+	return nb_words >= PROGRAM_HEADER_WORDS && ram[1] <= nb_words - PROGRAM_HEADER_WORDS;
+}
+
+bool event_program_next(const event_program_t* program, event_program_state_t* state, uint32_t* first_row, uint32_t* nb_rows) {
+	return run(program, state, first_row, nb_rows, NULL);
+}
@@ -0,0 +1,71 @@
+#ifndef _EVENT_PROGRAM_H_
+#define _EVENT_PROGRAM_H_
+
+/*
+Loop program: a bytecode giving the order of the passes over the func RAM rows, run by the event
+compiler instead of the fixed nest of the 1D to 4D scan dimensions when the loop program RAM holds one.
+
+The RAM starts with EVENT_PROGRAM_MAGIC and the number of instruction words which follow.
+An instruction is an opcode word, opcode << 24 | argument, then its operand words:
+
+	END							end of the sequence, as after the last instruction
+	EMIT	first	nb_rows					events of nb_rows rows from the first one, with the current element counters
+	LOOP	orders	iterations, nb_elements		runs the body up to the matching NEXT iterations times. The element counters
+											of the orders in the mask start at 0 and move to the next element at each
+											iteration, back to 0 after nb_elements (0 for never) and once the loop is over.
+											A loop without orders repeats the same events, as dummy scans do.
+	NEXT								end of the body of the innermost loop
+	BRANCH	level	iteration, target		jumps to the instruction at word target when the loop level (0 for the innermost)
+											is at that iteration
+	JUMP	-		target
+
+Jumps only go forward, within the same loop body, so every program ends and its number of events
+is known before it is compiled. As in the fixed nest, row 0 looks up the element counters it had
+the last time it was emitted, the FPGA only updating them after its event.
+*/
+
+#include "std_includes.h"
+
+#define EVENT_PROGRAM_MAGIC             0x4C4F4F50	//"LOOP"
+#define EVENT_PROGRAM_DEPTH             16			//nested loops
+#define EVENT_PROGRAM_ORDERS            16			//element counters, the SEQ_NB_OF_ORDERS of the compiler
+
+#define EVENT_OP_END                    0x00
+#define EVENT_OP_EMIT                   0x01
+#define EVENT_OP_LOOP                   0x02
+#define EVENT_OP_NEXT                   0x03
+#define EVENT_OP_BRANCH                 0x04
+#define EVENT_OP_JUMP                   0x05
+
+typedef struct {
+	const uint32_t* code;		//NULL when the RAM holds no program
+	uint32_t nb_words;
+	uint64_t nb_events;			//of the whole program
+	uint32_t orders;			//mask of the element counters moved by its loops
+} event_program_t;
+
+//The interpreter, between two EMITs.
+typedef struct {
+	uint32_t pc;
+	uint32_t depth;
+	uint32_t loops[EVENT_PROGRAM_DEPTH];		//pc of the LOOP of each level
+	uint32_t iterations[EVENT_PROGRAM_DEPTH];
+	uint32_t counters[EVENT_PROGRAM_ORDERS];	//element counters
+	uint32_t lagged[EVENT_PROGRAM_ORDERS];		//element counters row 0 looks up
+} event_program_state_t;
+
+//Finds the program in the loop program RAM, checks it against a sequence of nb_rows rows and counts its events.
+//Returns false, logging why, if the program is invalid or too long to run. program->code is NULL if there is none.
+bool event_program_load(event_program_t* program, const uint32_t* ram, uint32_t nb_rows);
+
+//Checks that what the host writes to the loop program RAM holds as many instruction words as its header says,
+//so that none are left over from a longer program written before. Anything without the magic is no program.
+bool event_program_complete(const void* data, uint32_t nbytes);
+
+//Starts the program from its first instruction.
+void event_program_start(const event_program_t* program, event_program_state_t* state);
+
+//Runs the program up to its next EMIT, returning the rows to emit, false once the program is over.
+bool event_program_next(const event_program_t* program, event_program_state_t* state, uint32_t* first_row, uint32_t* nb_rows);
+
+#endif
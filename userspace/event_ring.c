@@ -0,0 +1,75 @@
+#include "event_ring.h"
+#include "log.h"
+
+//the producer can be cancelled while waiting, the mutex must not stay locked
+static void unlock_mutex(void* mutex) {
+	pthread_mutex_unlock((pthread_mutex_t*)mutex);
+}
+
+bool event_ring_init(event_ring_t* ring, void* base, uint32_t base_address, uint32_t slot_bytes, uint32_t nb_slots) {
+	memset(ring, 0, sizeof(event_ring_t));
+
+	if (pthread_mutex_init(&ring->mutex, NULL) != 0) {
+		log_error("Unable to init mutex");
+		return false;
+	}
+
+	if (pthread_cond_init(&ring->cond, NULL) != 0) {
+		log_error("Unable to init condition");
+		pthread_mutex_destroy(&ring->mutex);
+		return false;
+	}
+
+	ring->base = base;
+	ring->base_address = base_address;
+	ring->slot_bytes = slot_bytes;
+	ring->nb_slots = nb_slots;
+	return true;
+}
+
+void event_ring_destroy(event_ring_t* ring) {
+	pthread_cond_destroy(&ring->cond);
+	pthread_mutex_destroy(&ring->mutex);
+}
+
+void* event_ring_acquire_free(event_ring_t* ring, uint32_t* address) {
+	void* slot = NULL;
+
+	pthread_mutex_lock(&ring->mutex);
+	pthread_cleanup_push(unlock_mutex, &ring->mutex);
+	while (!ring->aborted && ring->acquired - ring->released == ring->nb_slots) {
+		pthread_cond_wait(&ring->cond, &ring->mutex);
+	}
+	if (!ring->aborted) {
+		uint32_t offset = (ring->acquired % ring->nb_slots) * ring->slot_bytes;
+		slot = ring->base + offset;
+		*address = ring->base_address + offset;
+		ring->acquired++;
+	}
+	pthread_cleanup_pop(1);
+
+	return slot;
+}
+
+uint32_t event_ring_commit(event_ring_t* ring) {
+	pthread_mutex_lock(&ring->mutex);
+	uint32_t address = ring->base_address + (ring->produced % ring->nb_slots) * ring->slot_bytes;
+	ring->produced++;
+	pthread_mutex_unlock(&ring->mutex);
+
+	return address;
+}
+
+void event_ring_release(event_ring_t* ring) {
+	pthread_mutex_lock(&ring->mutex);
+	ring->released++;
+	pthread_cond_broadcast(&ring->cond);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+void event_ring_abort(event_ring_t* ring) {
+	pthread_mutex_lock(&ring->mutex);
+	ring->aborted = true;
+	pthread_cond_broadcast(&ring->cond);
+	pthread_mutex_unlock(&ring->mutex);
+}
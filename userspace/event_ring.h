@@ -0,0 +1,44 @@
+#ifndef _EVENT_RING_H_
+#define _EVENT_RING_H_
+
+/*
+Ring of event slots between the event compiler (producer) and the DMA engine.
+
+The ring lives in an events window of the reserved DDR, cut in nb_slots slots of slot_bytes.
+The producer fills a free slot, commits it and submits it to the DMA engine, whose completion
+releases the slot, so the compiler can run up to nb_slots - 1 chunks ahead of the transfer in progress.
+Several slots can be acquired before the first one is committed, to be filled in parallel,
+they are then committed in the order they were acquired.
+*/
+
+#include "std_includes.h"
+
+typedef struct {
+	uint8_t* base;			//virtual address of the window
+	uint32_t base_address;	//physical address of the window, as seen by the dmac
+	uint32_t slot_bytes;
+	uint32_t nb_slots;
+
+	uint32_t acquired;		//slots handed to the producer
+	uint32_t produced;		//slots committed by the producer
+	uint32_t released;		//slots whose transfer is done
+	bool aborted;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} event_ring_t;
+
+bool event_ring_init(event_ring_t* ring, void* base, uint32_t base_address, uint32_t slot_bytes, uint32_t nb_slots);
+void event_ring_destroy(event_ring_t* ring);
+
+//Waits for a free slot and gives its physical address, NULL if the ring has been aborted.
+void* event_ring_acquire_free(event_ring_t* ring, uint32_t* address);
+//The oldest acquired slot has been filled and handed to the dma, returns its physical address.
+uint32_t event_ring_commit(event_ring_t* ring);
+//The oldest committed slot has been transferred and can be reused.
+void event_ring_release(event_ring_t* ring);
+
+//Wakes up the producer, which then gives up.
+void event_ring_abort(event_ring_t* ring);
+
+#endif
@@ -15,6 +15,7 @@
 //RESERVED                      5
 #define FPGA_DMA_CONTROL        6
 //RESERVED                      7
+#define FPGA_DMA_REGISTERS_SPAN 32 //bytes
 
 //MACROS to more easily read the control status register bits
 #define FPGA_DMA_DONE                    0b00001 //DONE
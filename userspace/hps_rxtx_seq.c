@@ -1,67 +1,295 @@
 #include "hps_rxtx_seq.h"
 #include "hps_sequence.h"
 #include "hps_sequence_grad.h"
+#include "sequencer_interrupts.h"
+#include "sequence_rams.h"
+#include "commands.h"
+#include "hardware.h"
+#include "config.h"
+#include "common.h"
 #include "log.h"
 
-static pthread_t thread_rxtx;
-static pthread_t thread_grad;
-static pthread_attr_t attr;
+//one thread compiling and sending the events of each started sequence
+static struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool started;
+	bool requested;		//a run is waiting for the thread
+	bool running;
+	bool stopping;		//the service is shut down
+	long long abort_us;	//monotonic time of the abort of the run in progress, 0 if none
 
+	//precompiling the staged sequence, only driven by the commands
+	pthread_t stage_thread;
+	bool precompiling;	//stage_thread is to be joined
+	volatile bool cancel_precompile;
+	uint32_t stage_bank;
+} service = {
+	.started = false,
+};
 
+//the sequence was not started, as the amplifiers would have stopped it
+static void send_duty_limit(const events_report_t* report) {
+	message_t* message = create_message(AMPLIFIER_DUTY_LIMIT);
+	if (message == NULL) {
+		return;
+	}
+
+	message->header.param1 = report->duty_exceeded;
+	message->header.param2 = (int32_t)(report->duty * 10);
+	message->header.param3 = (int32_t)(config_rf_duty_limit() * 10);
+	sequencer_interrupts_send(message);
+}
+
+static void send_report(const events_report_t* report) {
+	message_t* message = create_message(MSG_EVENTS_REPORT);
+	if (message == NULL) {
+		return;
+	}
+
+	message->header.param1 = report->nb_events;
+	message->header.param2 = MINIMUM(report->compile_us, INT32_MAX);
+	message->header.param3 = MINIMUM(report->dma_stall_us, INT32_MAX);
+	message->header.param4 = MINIMUM(report->dma_bytes / 1024, INT32_MAX);
+	message->header.param5 = MINIMUM(report->elapsed_us, INT32_MAX);
+	//an aborted run gives how long the abort took, at least 1
+	message->header.param6 = report->completed ? 0 : MAXIMUM(MINIMUM(report->abort_us, INT32_MAX), 1);
+	sequencer_interrupts_send(message);
+}
+
+//RF/RX and gradient events are compiled in a single pass over the sequence, unless the host uploaded them
 static void* rxtx_seq_thread(void* arg) {
-	printf("rxtx events sent : %d\n",create_events());
-	pthread_exit(0);
+	pthread_mutex_lock(&service.mutex);
+	while (true) {
+		while (!service.stopping && !service.requested) {
+			pthread_cond_wait(&service.cond, &service.mutex);
+		}
+		if (service.stopping) {
+			break;
+		}
+
+		service.requested = false;
+		service.running = true;
+		service.abort_us = 0;
+		//a stop from now on aborts this run
+		events_abort_clear();
+		pthread_mutex_unlock(&service.mutex);
+
+		events_report_t report;
+		if (events_uploaded()) {
+			send_uploaded_events(&report);
+		}
+		else {
+			create_events_dual(&report);
+		}
+		events_ready_end(report.completed);
+		if (report.duty_exceeded != 0) {
+			send_duty_limit(&report);
+		}
+
+		pthread_mutex_lock(&service.mutex);
+		if (service.abort_us != 0 && !report.completed) {
+			report.abort_us = monotonic_us() - service.abort_us;
+			log_info("rxtx events aborted in %lld us", report.abort_us);
+		}
+		service.running = false;
+		pthread_mutex_unlock(&service.mutex);
+		send_report(&report);
+
+		pthread_mutex_lock(&service.mutex);
+		pthread_cond_broadcast(&service.cond);
+	}
+	pthread_mutex_unlock(&service.mutex);
+
+	return NULL;
+}
+
+static void* precompile_thread(void* arg) {
+	precompile_staged_events(service.stage_bank, &service.cancel_precompile);
+	return NULL;
 }
 
+//waits for the staged events to be compiled, or stops compiling them with cancel
+static void join_precompile(bool cancel) {
+	if (!service.precompiling) {
+		return;
+	}
 
-static void* grad_seq_thread(void* arg) {
-  printf("grad_events sent : %d\n",create_events_grad());
-	pthread_exit(0);
+	service.cancel_precompile = cancel;
+	pthread_join(service.stage_thread, NULL);
+	service.precompiling = false;
 }
 
+bool rxtx_seq_service_start() {
+	if (pthread_mutex_init(&service.mutex, NULL) != 0) {
+		log_error("Unable to init mutex");
+		return false;
+	}
 
-bool start_rxtx_seq(void) {
-	printf("here");
-	//start
-	/* Initialize and set thread detached attribute */
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-	if (pthread_create(&thread_rxtx, &attr, rxtx_seq_thread, NULL) != 0) {
-		log_error("Unable to create rxtx thread!");
+	if (pthread_cond_init(&service.cond, NULL) != 0) {
+		log_error("Unable to init condition");
+		pthread_mutex_destroy(&service.mutex);
 		return false;
 	}
-	
-	
-	if (pthread_create(&thread_grad, &attr, grad_seq_thread, NULL) != 0) {
-		log_error("Unable to create grad thread!");
+
+	service.requested = false;
+	service.running = false;
+	service.stopping = false;
+	service.precompiling = false;
+	if (pthread_create(&service.thread, NULL, rxtx_seq_thread, NULL) != 0) {
+		log_error_errno("Unable to create rxtx thread");
+		pthread_cond_destroy(&service.cond);
+		pthread_mutex_destroy(&service.mutex);
 		return false;
 	}
 
-	/*
-	if (pthread_join(thread_rxtx,NULL) != 0) {
-		log_error("Unable to join rxtx thread!");
+	service.started = true;
+	return true;
+}
+
+void rxtx_seq_service_stop() {
+	if (!service.started) {
+		return;
+	}
+
+	stop_rxtx_seq();
+	join_precompile(true);
+	pthread_mutex_lock(&service.mutex);
+	service.stopping = true;
+	pthread_cond_broadcast(&service.cond);
+	pthread_mutex_unlock(&service.mutex);
+	pthread_join(service.thread, NULL);
+
+	pthread_cond_destroy(&service.cond);
+	pthread_mutex_destroy(&service.mutex);
+	service.started = false;
+}
+
+bool start_rxtx_seq(void) {
+	if (!service.started) {
+		log_error("rxtx service not started");
 		return false;
 	}
-	if (pthread_join(thread_grad, NULL) != 0) {
-		log_error("Unable to join grad thread!");
+
+	//the events of the previous sequence would be sent before the new ones
+	if (!stop_rxtx_seq()) {
+		log_error("Not starting the rxtx events, the previous run is still stopping");
 		return false;
 	}
-	*/
+	events_ready_reset(config_prefill_events());
 
-	//pthread_exit(NULL);
+	pthread_mutex_lock(&service.mutex);
+	service.requested = true;
+	pthread_cond_broadcast(&service.cond);
+	pthread_mutex_unlock(&service.mutex);
 	return true;
 }
 
+bool wait_rxtx_seq_ready(void) {
+	int timeout_ms = config_ready_timeout_ms();
+	if (events_wait_ready(timeout_ms)) {
+		return true;
+	}
+
+	//as CMD_STOP_SEQUENCE, so the run does not go on feeding fifos which nothing reads
+	log_error("Sequence not started, its first %d events were not sent within %d ms", config_prefill_events(), timeout_ms);
+	stop_rxtx_seq();
+	stop_sequence();
+	message_t* message = create_message(MSG_EVENTS_NOT_READY);
+	if (message != NULL) {
+		message->header.param1 = config_prefill_events();
+		message->header.param2 = timeout_ms;
+		sequencer_interrupts_send(message);
+	}
+	return false;
+}
+
+bool rxtx_seq_running(void) {
+	if (!service.started) {
+		return false;
+	}
+
+	pthread_mutex_lock(&service.mutex);
+	bool running = service.requested || service.running;
+	pthread_mutex_unlock(&service.mutex);
+	return running;
+}
+
 bool stop_rxtx_seq(void) {
-	printf("cancelling thread \n");
-	if (pthread_cancel(thread_rxtx) != 0) {
-		log_error("Unable to cancel rxtx_seq_thread");
+	if (!service.started) {
+		return false;
+	}
+
+	int timeout_ms = config_abort_timeout_ms();
+	struct timespec deadline;
+	deadline_in_ms(&deadline, timeout_ms);
+
+	pthread_mutex_lock(&service.mutex);
+	if (service.requested) {
+		//the run did not start, nothing will be ready
+		service.requested = false;
+		events_ready_end(false);
+	}
+	int result = 0;
+	if (service.running) {
+		log_info("Aborting rxtx events");
+		if (service.abort_us == 0) {
+			service.abort_us = monotonic_us();
+		}
+		events_abort();
+		while (service.running && result == 0) {
+			result = timeout_ms > 0 ? pthread_cond_timedwait(&service.cond, &service.mutex, &deadline)
+				: pthread_cond_wait(&service.cond, &service.mutex);
+		}
+	}
+	bool stopped = !service.running;
+	pthread_mutex_unlock(&service.mutex);
+
+	if (!stopped) {
+		log_error("rxtx events still running %d ms after the abort", timeout_ms);
+	}
+	return stopped;
+}
+
+void stage_rxtx_seq_begin(void) {
+	//the staged rams are about to be dropped
+	join_precompile(true);
+	sequence_rams_stage_begin();
+}
+
+bool stage_rxtx_seq_end(void) {
+	uint32_t bank;
+	if (!sequence_rams_stage_end(&bank)) {
+		log_error("No sequence being staged");
 		return false;
 	}
- 	if (pthread_cancel(thread_grad) != 0) {
-		log_error("Unable to cancel grad_seq_thread");
+
+	join_precompile(true);
+	service.stage_bank = bank;
+	service.cancel_precompile = false;
+	if (pthread_create(&service.stage_thread, NULL, precompile_thread, NULL) != 0) {
+		log_error_errno("Unable to create precompile thread");
 		return false;
 	}
+	service.precompiling = true;
 	return true;
-}
\ No newline at end of file
+}
+
+bool start_staged_rxtx_seq(void (*write_register)(uint32_t index, uint32_t value)) {
+	if (!service.started) {
+		log_error("rxtx service not started");
+		return false;
+	}
+
+	//the run reads the active bank, and whatever was compiled ahead is faster than compiling again
+	if (!stop_rxtx_seq()) {
+		log_error("Not swapping the staged sequence, the previous run is still stopping");
+		return false;
+	}
+	join_precompile(false);
+	if (!sequence_rams_swap(write_register)) {
+		return false;
+	}
+	return start_rxtx_seq();
+}
@@ -1,10 +1,47 @@
 #ifndef _HPS_RXTX_SEQ_H_
 #define _HPS_RXTX_SEQ_H_
 
+/*
+Compilation service: a thread compiling the RF and gradient events of each started sequence
+and feeding them to the FPGA, or only feeding the events compiled by the host (see events_upload()). When a run is over, a MSG_EVENTS_REPORT message gives the client
+the events sent, the compile time, how long the DMA waited for events and the bytes sent.
+
+An abort is cooperative: the compiler stops at the next slot, the transfer in progress is stopped
+and the dmac reset, then the run reports how long that took.
+*/
+
 #include "std_includes.h"
 
+//Starts the service thread, waiting for sequences.
+bool rxtx_seq_service_start();
+
+//Aborts the run in progress and stops the service thread.
+void rxtx_seq_service_stop();
+
+//Compiles and sends the events of the sequence in the RAMs, a run in progress is aborted first.
+//Returns false if it could not be stopped.
 bool start_rxtx_seq();
+
+//Waits for the first config_prefill_events() events of the started run to be in the FPGA fifos,
+//for at most config_ready_timeout_ms(). Returns false if they could not be sent in time,
+//the run being stopped and the client sent MSG_EVENTS_NOT_READY.
+bool wait_rxtx_seq_ready();
+
+//True while a started run is waiting for the thread or sending events.
+bool rxtx_seq_running();
+
+//Aborts the run in progress, returns once its thread let go of the DMA.
+//Returns false if it still holds it after config_abort_timeout_ms().
 bool stop_rxtx_seq();
 
-#endif
+//Stages the next sequence while the current one runs: the sequence RAMs and registers written
+//after stage_rxtx_seq_begin() go to the staged bank of sequence_rams.h, and stage_rxtx_seq_end()
+//starts compiling its events into the caches of that bank in the background.
+void stage_rxtx_seq_begin();
+bool stage_rxtx_seq_end();
 
+//Swaps the staged sequence in and starts compiling and sending its events like start_rxtx_seq().
+//write_register writes the registers staged for the hardware. False if no sequence was staged.
+bool start_staged_rxtx_seq(void (*write_register)(uint32_t index, uint32_t value));
+
+#endif
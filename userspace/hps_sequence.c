@@ -1,801 +1,831 @@
 #include "hps_sequence.h"
+#include "hps_sequence_grad.h"
 #include "fpga_dmac_api.h"
-
-extern void* reserved_mem_base;
-
-//#define HPS_OCR_ADDRESS           0xFFE00000 
+#include "common.h"
+#include "log.h"
+#include "sequence_rams.h"
+#include "event_ring.h"
+#include "dma_engine.h"
+#include "config.h"
+#include "shared_memory.h"
+#include "compile_pool.h"
+#include "ddr_layout.h"
+
+//#define HPS_OCR_ADDRESS           0xFFE00000
 //#define HPS_OCR_SPAN              2097152            //span in bytes
 
-#define DDR_EVENTS_ADDRESS			1598029824          //use upper portion of the 1GB
-#define DDR_EVENTS_SPAN			    65536                //span in bytes
-
 #define LW_BASE                     0xff200000
-#define LW_SPAN                     1048576
 #define FPGA_DMAC_QSYS_ADDRESS      0x00020080
 #define FPGA_DMAC_ADDRESS           ((uint8_t*)LW_BASE+FPGA_DMAC_QSYS_ADDRESS)
 
-//fifo is connected directly to dma
-#define DMA_TRANSFER_DST_DMAC       0x0
 #define DMA_FULL_BURST_IN_BYTES     16384 //1024*16 this is 128 event
-#define DMA_TRANSFER_1_SRC_DMAC     (DDR_EVENTS_ADDRESS)
-#define DMA_TRANSFER_2_SRC_DMAC     (DDR_EVENTS_ADDRESS+DMA_FULL_BURST_IN_BYTES)
-#define DMA_TRANSFER_3_SRC_DMAC     (DDR_EVENTS_ADDRESS+(2*DMA_FULL_BURST_IN_BYTES))
-#define DMA_TRANSFER_4_SRC_DMAC     (DDR_EVENTS_ADDRESS+(3*DMA_FULL_BURST_IN_BYTES))
-
-//scan counters
-#define _PS 0
-#define _DS 1
-#define _1D 2
-#define _2D 3
-#define _3D 4
-#define _4D 5
-
-static uint32_t scan_counters[6] = { 0,0,0,0,0,0 };
-static uint32_t loopa_counters[2] = { 0,0 };
-
-// nb of elements per counter to be used for the modulus
-#define O_0  0
-#define O_1D 1
-#define O_2D 2
-#define O_3D 3
-#define O_4D 4
-
-//orders pegged counters  
-static uint32_t modded_scan_counters[16] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
-static uint32_t nb_elements_per_counter[16]; 
 
 uint32_t printjer(void) {
     printf("HAHAHAHAHA \n");
     return 10;
 }
 
-uint32_t static inline get_addr(uint32_t* modded_scan_counter, uint32_t base_address, uint32_t order) {
-    return (modded_scan_counter[order] + base_address );
+//where the slots of a stream are
+typedef enum {
+    STREAM_RING,            //compiled into the ring of the events window
+    STREAM_CACHE_FILL,      //compiled into the cache, kept for the next runs
+    STREAM_CACHE_PATCH,     //element values changed, patched in the cache then sent again
+    STREAM_CACHE_REPLAY,    //sent again from the cache, nothing to compile
+} stream_mode_t;
+
+//the slots of one stream of events and the dma engine sending them
+typedef struct {
+    const char* name;
+    stream_mode_t mode;
+    event_cache_t* cache;
+    uint64_t generation;
+    uint32_t slot_bytes;
+    uint32_t event_bytes;
+    event_ring_t ring;
+    dma_engine_t engine;
+    dma_descriptor_t* descriptors;  //one per slot of the ring, or per slot of the cache
+    uint32_t nb_descriptors;
+    uint32_t nb_acquired;
+    uint32_t nb_submitted;
+    uint32_t nb_events;
+    long long compile_us;           //compiling or patching the events
+    uint32_t prefill;               //events to transfer before the run is ready
+    uint32_t nb_transferred;        //events which reached the fifo
+} stream_t;
+
+//the streams being sent, which another thread can abort
+static pthread_mutex_t streams_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stream_t* open_streams[2];
+static bool streams_aborted = false;
+
+//events uploaded by the host into the caches of a bank, sent instead of compiling the sequence rams
+static struct {
+    bool active;
+    uint32_t bank;
+    uint32_t bytes[2];      //per stream
+} uploaded = {
+    .active = false,
+};
+
+//the replayed upload looks like a sequence the rams never reach
+#define UPLOADED_GENERATION UINT64_MAX
+
+//analytics of the last sequences, one per bank so that analyzing the staged one keeps the active one
+static pthread_mutex_t analytics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static event_analytics_t analyzed[SEQUENCE_RAM_BANKS];
+static uint32_t analyzed_next = 0;
+
+//whether the first events of the run reached the fifos, see events_wait_ready()
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t ready_prefill = 0;
+static bool run_prefilled = false;
+static bool run_over = true;
+static bool run_feeding = false;    //a stream is open, the sequence was analyzed and accepted
+
+static void stream_abort(stream_t* stream) {
+    event_ring_abort(&stream->ring);
+    dma_engine_abort(&stream->engine);
 }
 
-uint32_t create_events(void) {
-    int fd;
-    if ((fd = open("/dev/mem", (O_RDWR | O_SYNC))) == -1) {
-        printf("ERROR: could not open \"/dev/mem\"...\n");
-        return(1);
-    }
-    
-    //access events space
-    
-    void* events_base    = mmap( NULL, DDR_EVENTS_SPAN, (PROT_READ | PROT_WRITE),
-                            MAP_SHARED, fd, DDR_EVENTS_ADDRESS);
-
-    if (events_base == MAP_FAILED) {
-        printf("ERROR: mmap() events_base failed...\n");
-        close(fd);
-        return(1);
-    }
-    int_fast32_t* events_base_ptr = (int_fast32_t*)events_base;
-    
-
-    //mmap dmac addr
-    void* lw_vaddr;
-    lw_vaddr = mmap(NULL, LW_SPAN, (PROT_READ | PROT_WRITE),
-        MAP_SHARED, fd, LW_BASE);
-
-    if (lw_vaddr == MAP_FAILED) {
-        printf("ERROR: mmap() lw failed...\n");
-        close(fd);
-        return(1);
-    }
-
-    //virtual addresses for all components
-    void* FPGA_DMA_vaddr_void = (uint8_t*)lw_vaddr + FPGA_DMAC_QSYS_ADDRESS;
-
-
-    printf("Initializing DMA Controller\n");
-    fpga_dma_write_reg(FPGA_DMA_vaddr_void,
-        FPGA_DMA_CONTROL,
-        FPGA_DMA_QUADWORD_TRANSFERS |
-        FPGA_DMA_END_WHEN_LENGHT_ZERO
-    );
-
-    fpga_dma_write_reg(FPGA_DMA_vaddr_void,  //set destiny address
-        FPGA_DMA_WRITEADDRESS,
-        (uint32_t)DMA_TRANSFER_DST_DMAC);
-
-
-    //RAMS
-   uint32_t* base_rams                          = (uint32_t*)reserved_mem_base;
-   uint32_t* ram_func_base                      = base_rams  + 0  * STEP_32b_RAM;
-   uint32_t* ram_ttl_base                       = base_rams  + 1  * STEP_32b_RAM;
-   uint32_t* ram_orders_base                    = base_rams  + 3  * STEP_32b_RAM;
-   uint32_t* ram_adr_c1_base                    = base_rams  + 4  * STEP_32b_RAM;
-   uint32_t* ram_adr_c2_base                    = base_rams  + 5  * STEP_32b_RAM;
-   uint32_t* ram_adr_c3_base                    = base_rams  + 6  * STEP_32b_RAM;
-   uint32_t* ram_adr_c4_base                    = base_rams  + 7  * STEP_32b_RAM;
-   uint32_t* ram_adr_c1b_base                   = base_rams  + 111 * STEP_32b_RAM;
-   uint32_t* ram_adr_c2b_base                   = base_rams  + 112 * STEP_32b_RAM;
-   uint32_t* ram_adr_c3b_base                   = base_rams  + 113 * STEP_32b_RAM;
-   uint32_t* ram_adr_c4b_base                   = base_rams  + 114 * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points0_base             = base_rams  + 41  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points1_base             = base_rams  + 42  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points2_base             = base_rams  + 43  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points3_base             = base_rams  + 44  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points4_base             = base_rams  + 45  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points5_base             = base_rams  + 46  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points6_base             = base_rams  + 47  * STEP_32b_RAM;
-   uint32_t* ram_nb_of_points7_base             = base_rams  + 48  * STEP_32b_RAM;
-   uint32_t* ram_smart_ttl_adr_att_base         = base_rams  + 90  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param1b_base          = base_rams  + 95  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param2b_base          = base_rams  + 96  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param3b_base          = base_rams  + 97  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param4b_base          = base_rams  + 98  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param1_base           = base_rams  + 8   * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param2_base           = base_rams  + 9   * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param3_base           = base_rams  + 10  * STEP_32b_RAM;
-   uint32_t* ram_tx_shape_param4_base           = base_rams  + 11  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param1_base     = base_rams  + 74  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param2_base     = base_rams  + 75  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param3_base     = base_rams  + 76  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param4_base     = base_rams  + 77  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param1b_base    = base_rams  + 103  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param2b_base    = base_rams  + 104  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param3b_base    = base_rams  + 105  * STEP_32b_RAM;
-   uint32_t* ram_tx_phase_shape_param4b_base    = base_rams  + 106  * STEP_32b_RAM;
-    
-
-    //event ram
-    uint32_t* ram_func_ptr                        =  ram_func_base                   ;
-    uint32_t* ram_ttl_ptr                         =  ram_ttl_base                    ;
-    uint32_t* ram_orders_ptr                      =  ram_orders_base                 ;
-    uint32_t* ram_adr_c1_ptr                      =  ram_adr_c1_base                 ;
-    uint32_t* ram_adr_c2_ptr                      =  ram_adr_c2_base                 ;
-    uint32_t* ram_adr_c3_ptr                      =  ram_adr_c3_base                 ;
-    uint32_t* ram_adr_c4_ptr                      =  ram_adr_c4_base                 ;
-    uint32_t* ram_adr_c1b_ptr                     =  ram_adr_c1b_base                ;
-    uint32_t* ram_adr_c2b_ptr                     =  ram_adr_c2b_base                ;
-    uint32_t* ram_adr_c3b_ptr                     =  ram_adr_c3b_base                ;
-    uint32_t* ram_adr_c4b_ptr                     =  ram_adr_c4b_base                ;
-    uint32_t* ram_nb_of_points0_ptr               =  ram_nb_of_points0_base          ;
-    uint32_t* ram_nb_of_points1_ptr               =  ram_nb_of_points1_base          ;
-    uint32_t* ram_nb_of_points2_ptr               =  ram_nb_of_points2_base          ;
-    uint32_t* ram_nb_of_points3_ptr               =  ram_nb_of_points3_base          ;
-    uint32_t* ram_nb_of_points4_ptr               =  ram_nb_of_points4_base          ;
-    uint32_t* ram_nb_of_points5_ptr               =  ram_nb_of_points5_base          ;
-    uint32_t* ram_nb_of_points6_ptr               =  ram_nb_of_points6_base          ;
-    uint32_t* ram_nb_of_points7_ptr               =  ram_nb_of_points7_base          ;
-    uint32_t* ram_smart_ttl_adr_att_ptr           =  ram_smart_ttl_adr_att_base      ;
-    uint32_t* ram_tx_shape_param1b_ptr            =  ram_tx_shape_param1b_base       ;
-    uint32_t* ram_tx_shape_param2b_ptr            =  ram_tx_shape_param2b_base       ;
-    uint32_t* ram_tx_shape_param3b_ptr            =  ram_tx_shape_param3b_base       ;
-    uint32_t* ram_tx_shape_param4b_ptr            =  ram_tx_shape_param4b_base       ;
-    uint32_t* ram_tx_shape_param1_ptr             =  ram_tx_shape_param1_base        ;
-    uint32_t* ram_tx_shape_param2_ptr             =  ram_tx_shape_param2_base        ;
-    uint32_t* ram_tx_shape_param3_ptr             =  ram_tx_shape_param3_base        ;
-    uint32_t* ram_tx_shape_param4_ptr             =  ram_tx_shape_param4_base        ;
-    uint32_t* ram_tx_phase_shape_param1_ptr       =  ram_tx_phase_shape_param1_base  ;
-    uint32_t* ram_tx_phase_shape_param2_ptr       =  ram_tx_phase_shape_param2_base  ;
-    uint32_t* ram_tx_phase_shape_param3_ptr       =  ram_tx_phase_shape_param3_base  ;
-    uint32_t* ram_tx_phase_shape_param4_ptr       =  ram_tx_phase_shape_param4_base  ;
-    uint32_t* ram_tx_phase_shape_param1b_ptr      =  ram_tx_phase_shape_param1b_base ;
-    uint32_t* ram_tx_phase_shape_param2b_ptr      =  ram_tx_phase_shape_param2b_base ;
-    uint32_t* ram_tx_phase_shape_param3b_ptr      =  ram_tx_phase_shape_param3b_base ;
-    uint32_t* ram_tx_phase_shape_param4b_ptr      =  ram_tx_phase_shape_param4b_base ;
-
-    //element ram
-    uint32_t* ram_timer_ptr     = base_rams + 49 * STEP_32b_RAM;
-
-    uint32_t* ram_freq1_ptr     = base_rams + 25 * STEP_32b_RAM;
-    uint32_t* ram_phase1_ptr    = base_rams + 26 * STEP_32b_RAM;
-    uint32_t* ram_amp1_ptr      = base_rams + 27 * STEP_32b_RAM;
-   // uint32_t* ram_tx_shape1_ptr = base_rams + 28 * STEP_32b_RAM;
-    uint32_t* ram_freq2_ptr     = base_rams + 29 * STEP_32b_RAM;
-    uint32_t* ram_phase2_ptr    = base_rams + 30 * STEP_32b_RAM;
-    uint32_t* ram_amp2_ptr      = base_rams + 31 * STEP_32b_RAM;
-   // uint32_t* ram_tx_shape2_ptr = base_rams + 32 * STEP_32b_RAM;
-    uint32_t* ram_freq3_ptr     = base_rams + 33 * STEP_32b_RAM;
-    uint32_t* ram_phase3_ptr    = base_rams + 34 * STEP_32b_RAM;
-    uint32_t* ram_amp3_ptr      = base_rams + 35 * STEP_32b_RAM;
-   // uint32_t* ram_tx_shape3_ptr = base_rams + 36 * STEP_32b_RAM;
-    uint32_t* ram_freq4_ptr     = base_rams + 37 * STEP_32b_RAM;
-    uint32_t* ram_phase4_ptr    = base_rams + 38 * STEP_32b_RAM;
-    uint32_t* ram_amp4_ptr      = base_rams + 39 * STEP_32b_RAM;
-
-
-
-    uint32_t* base_of_regs = (uint32_t*)reserved_mem_base + (131072 * 87);
-    uint32_t  nb_dimensions[6];
-    nb_dimensions[_DS]            = *(base_of_regs + 7);
-    nb_dimensions[_1D]            = *(base_of_regs + 8);
-    nb_dimensions[_2D]            = *(base_of_regs + 9);
-    nb_dimensions[_3D]            = *(base_of_regs + 10);
-    nb_dimensions[_4D]            = *(base_of_regs + 11);
-    nb_dimensions[_PS]            = *(base_of_regs + 93);
-
-    nb_elements_per_counter[O_0]  = 1+ 0;
-    nb_elements_per_counter[O_1D] = 1+ *(base_of_regs + 12);
-    nb_elements_per_counter[O_2D] = 1+ *(base_of_regs + 13);
-    nb_elements_per_counter[O_3D] = 1+ *(base_of_regs + 14);
-    nb_elements_per_counter[O_4D] = 1+ *(base_of_regs + 15);
+//an abort requested before the stream is open stops it right away
+static void stream_register(stream_t* stream, uint64_t nb_events) {
+    pthread_mutex_lock(&streams_mutex);
+    for (int i = 0; i < 2; i++) {
+        if (open_streams[i] == NULL) {
+            open_streams[i] = stream;
+            break;
+        }
+    }
+    stream->prefill = MINIMUM(ready_prefill, nb_events);
+    run_feeding = true;
+    pthread_cond_broadcast(&ready_cond);
+    if (streams_aborted) {
+        stream_abort(stream);
+    }
+    pthread_mutex_unlock(&streams_mutex);
+}
 
+static void stream_unregister(stream_t* stream) {
+    pthread_mutex_lock(&streams_mutex);
+    for (int i = 0; i < 2; i++) {
+        if (open_streams[i] == stream) {
+            open_streams[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&streams_mutex);
+}
 
-    uint32_t nb_of_all_events = 0;
-    
-    /*
-    for (int i = 0; i < 5; i++) {
-        printf("ram ttl %d at %x \n", i, ram_ttl_ptr[i]);
-    }
-    */
-
-
-    for (int i = 0; i < 5; i++) {
-        printf("ram_adr_c1b %d at %x \n", i, ram_adr_c1b_ptr[i]);
-    }
-
-    for (int i = 0; i < 5; i++) {
-        printf("ram_amp1 %d at %x \n", i, ram_amp1_ptr[i]);
-    }
-    
-    for (int i = 0; i < _4D; i++) {
-        printf("NB scans %d at %x \n", i, nb_dimensions[i]);
-    }
-    
-    for (int i = 0; i < O_4D; i++) {
-        printf("NB elements %d at %x \n", i, nb_elements_per_counter[i]);
-    }
-
-    uint32_t nb_of_events_treated = 0; 
-    bool is_second_trans = false;
-
-    for (scan_counters[_4D] = 0; scan_counters[_4D] <= nb_dimensions[_4D]; scan_counters[_4D]++) {
-        for (scan_counters[_3D] = 0; scan_counters[_3D] <= nb_dimensions[_3D]; scan_counters[_3D]++) {
-            for (scan_counters[_2D] = 0; scan_counters[_2D] <= nb_dimensions[_2D]; scan_counters[_2D]++) {
-                for (scan_counters[_1D] = 0; scan_counters[_1D] <= nb_dimensions[_1D]; scan_counters[_1D]++) {
-                    while (true) {
-
-                        //get the current event
-                        //get the timer address : look at the timer addr and timer order
-                        int_fast32_t timer_base_addr             = ((0x3FF   << 22) & *ram_func_ptr) >> 22;
-                        int_fast32_t timer_order                 = ((0xF     << 18) & *ram_func_ptr) >> 18;
-
-                        int_fast32_t timer_addr                  = get_addr(modded_scan_counters, timer_base_addr, timer_order);
-
-                        //get the tx address
-                        //enables
-                        int_fast8_t   tx1_en                 = ((0x1     << 14) & *ram_func_ptr) >> 14;
-                        int_fast8_t   tx2_en                 = ((0x1     << 15) & *ram_func_ptr) >> 15;
-                        int_fast8_t   tx3_en                 = ((0x1     << 16) & *ram_func_ptr) >> 16;
-                        int_fast8_t   tx4_en                 = ((0x1     << 17) & *ram_func_ptr) >> 17;
-                        int_fast8_t   ph_reset               = ((0x1     <<  6) & *ram_func_ptr) >> 6;
-                        int_fast8_t   tx1_sw_att             = ((0x1     << 13) & *ram_smart_ttl_adr_att_ptr) >> 13;
-                        int_fast8_t   tx2_sw_att             = ((0x1     << 14) & *ram_smart_ttl_adr_att_ptr) >> 14;
-                        int_fast8_t   tx3_sw_att             = ((0x1     << 15) & *ram_smart_ttl_adr_att_ptr) >> 15;
-                        int_fast8_t   tx4_sw_att             = ((0x1     << 16) & *ram_smart_ttl_adr_att_ptr) >> 16;
-
-                        //freq
-                        int_fast32_t  tx1_freq_base_addr         = ((0x3FF   << 0 ) & *ram_adr_c1_ptr) >> 0;
-                        int_fast32_t  tx1_freq_order             = ((0xF     << 0 ) & *ram_orders_ptr) >> 0;
-                        int_fast32_t  tx1_freq_addr              = get_addr(modded_scan_counters, tx1_freq_base_addr, tx1_freq_order);
-                        //phase
-                        int_fast32_t  tx1_phase_base_addr        = ((0x3FF   << 0)  & *ram_adr_c1b_ptr) >> 0;
-                        int_fast32_t  tx1_phase_order            = ((0xF     << 16) & *ram_orders_ptr) >> 16;
-                        int_fast32_t  tx1_phase_addr             = get_addr(modded_scan_counters, tx1_phase_base_addr, tx1_phase_order);
-                        //amp
-                        int_fast32_t  tx1_amp_base_addr          = ((0x3FF   << 11) & *ram_adr_c1b_ptr) >> 11;
-                        int_fast32_t  tx1_amp_order              = ((0xF     << 22) & *ram_adr_c1b_ptr) >> 22;
-                        int_fast32_t  tx1_amp_addr               = get_addr(modded_scan_counters, tx1_amp_base_addr, tx1_amp_order);
-
-
-                        int_fast32_t  tx2_freq_base_addr         = ((0x3FF   << 0 ) & *ram_adr_c2_ptr) >> 0;
-                        int_fast32_t  tx2_freq_order             = ((0xF     << 4 ) & *ram_orders_ptr) >> 4;
-                        int_fast32_t  tx2_freq_addr              = get_addr(modded_scan_counters, tx2_freq_base_addr, tx2_freq_order);
-                        //phase
-                        int_fast32_t  tx2_phase_base_addr        = ((0x3FF   << 0)  & *ram_adr_c2b_ptr) >> 0;
-                        int_fast32_t  tx2_phase_order            = ((0xF     << 16) & *ram_orders_ptr) >> 16;
-                        int_fast32_t  tx2_phase_addr             = get_addr(modded_scan_counters, tx2_phase_base_addr, tx2_phase_order);
-                        //amp
-                        int_fast32_t  tx2_amp_base_addr          = ((0x3FF   << 11) & *ram_adr_c2b_ptr) >> 11;
-                        int_fast32_t  tx2_amp_order              = ((0xF     << 22) & *ram_adr_c2b_ptr) >> 22;
-                        int_fast32_t  tx2_amp_addr               = get_addr(modded_scan_counters, tx2_amp_base_addr, tx2_amp_order);
-                        
-                        //    
-                        int_fast32_t  tx3_freq_base_addr         = ((0x3FF   << 0 ) & *ram_adr_c3_ptr) >> 0;
-                        int_fast32_t  tx3_freq_order             = ((0xF     << 8 ) & *ram_orders_ptr) >> 8;
-                        int_fast32_t  tx3_freq_addr              = get_addr(modded_scan_counters, tx3_freq_base_addr, tx3_freq_order);
-                        //phase
-                        int_fast32_t  tx3_phase_base_addr        = ((0x3FF   << 0)  & *ram_adr_c3b_ptr) >> 0;
-                        int_fast32_t  tx3_phase_order            = ((0xF     << 16) & *ram_orders_ptr) >> 16;
-                        int_fast32_t  tx3_phase_addr             = get_addr(modded_scan_counters, tx3_phase_base_addr, tx3_phase_order);
-                        //amp
-                        int_fast32_t  tx3_amp_base_addr          = ((0x3FF   << 11) & *ram_adr_c3b_ptr) >> 11;
-                        int_fast32_t  tx3_amp_order              = ((0xF     << 22) & *ram_adr_c3b_ptr) >> 22;
-                        int_fast32_t  tx3_amp_addr               = get_addr(modded_scan_counters, tx3_amp_base_addr, tx3_amp_order);
-                        
-                        //    
-                        int_fast32_t  tx4_freq_base_addr         = ((0x3FF   << 0 ) & *ram_adr_c4_ptr) >> 0;
-                        int_fast32_t  tx4_freq_order             = ((0xF     << 12) & *ram_orders_ptr) >> 12;
-                        int_fast32_t  tx4_freq_addr              = get_addr(modded_scan_counters, tx4_freq_base_addr, tx4_freq_order);
-                        //phase
-                        int_fast32_t  tx4_phase_base_addr        = ((0x3FF   << 0)  & *ram_adr_c4b_ptr) >> 0;
-                        int_fast32_t  tx4_phase_order            = ((0xF     << 16) & *ram_orders_ptr) >> 16;
-                        int_fast32_t  tx4_phase_addr             = get_addr(modded_scan_counters, tx4_phase_base_addr, tx4_phase_order);
-                        //amp
-                        int_fast32_t  tx4_amp_base_addr          = ((0x3FF   << 11) & *ram_adr_c4b_ptr) >> 11;
-                        int_fast32_t  tx4_amp_order              = ((0xF     << 22) & *ram_adr_c4b_ptr) >> 22;
-                        int_fast32_t  tx4_amp_addr               = get_addr(modded_scan_counters, tx4_amp_base_addr, tx4_amp_order);
-
-
-                        //save the event
-
-                        //0
-                        events_base_ptr[0] = ram_timer_ptr[timer_addr];
-                        //32
-                        events_base_ptr[1] = *ram_ttl_ptr;
-                        //64
-                        events_base_ptr[2] = ram_freq1_ptr[tx1_freq_addr];
-                        //96
-                        events_base_ptr[3] = (ph_reset&0x1) << 30 | tx1_sw_att << 29 |tx1_en << 28 | (ram_amp1_ptr[tx1_amp_addr]&0xfff)<<16 | (ram_phase1_ptr[tx1_phase_addr]&0xffff);
-                        //128
-                        events_base_ptr[4] = (*ram_tx_shape_param1b_ptr&0x7FFF) << 17 | (*ram_tx_shape_param1_ptr&0x1FFFF);
-                        //160
-                        events_base_ptr[5] = (*ram_tx_phase_shape_param1b_ptr&0x7FFF) << 17 | (*ram_tx_phase_shape_param1_ptr&0x1FFFF);
-                        //192
-                        events_base_ptr[6] = ram_freq2_ptr[tx2_freq_addr];
-                        //224
-                        events_base_ptr[7] = tx2_sw_att << 29 | tx2_en << 28 | (ram_amp2_ptr[tx2_amp_addr]&0xffff)<<16 | (ram_phase2_ptr[tx2_phase_addr]&0xffff);
-                        //256
-                        events_base_ptr[8] = (*ram_tx_shape_param2b_ptr&0x7FFF) << 17 | (*ram_tx_shape_param2_ptr&0x1FFFF);
-                        //288              
-                        events_base_ptr[9] = (*ram_tx_phase_shape_param2b_ptr&0x7FFF) << 17 | (*ram_tx_phase_shape_param2_ptr&0x1FFFF);
-                        //320
-                        events_base_ptr[10] = ram_freq3_ptr[tx3_freq_addr];
-                        //352
-                        events_base_ptr[11] = tx3_sw_att << 29 | tx3_en << 28 | (ram_amp3_ptr[tx3_amp_addr]&0xffff)<<16 | (ram_phase3_ptr[tx3_phase_addr]&0xffff);
-                        //384
-                        events_base_ptr[12] = (*ram_tx_shape_param3b_ptr&0x7FFF) << 17 | (*ram_tx_shape_param3_ptr&0x1FFFF);
-                        //416              
-                        events_base_ptr[13] = (*ram_tx_phase_shape_param3b_ptr&0x7FFF) << 17 | (*ram_tx_phase_shape_param3_ptr&0x1FFFF);
-                        //448
-                        events_base_ptr[14] = ram_freq4_ptr[tx4_freq_addr];
-                        //480
-                        events_base_ptr[15] = tx4_sw_att << 29 | tx4_en << 28 | (ram_amp4_ptr[tx4_amp_addr]&0xffff)<<16 | (ram_phase4_ptr[tx4_phase_addr]&0xffff);
-                        //512
-                        events_base_ptr[16] = (*ram_tx_shape_param4b_ptr&0x7FFF) << 17 | (*ram_tx_shape_param4_ptr&0x1FFFF);
-                         //544             
-                        events_base_ptr[17] = (*ram_tx_phase_shape_param4b_ptr&0x7FFF) << 17 | (*ram_tx_phase_shape_param4_ptr&0x1FFFF);
-                        
-                        // next assignments must be optimized
-                       
-                        //576
-                        events_base_ptr[18] = 1<<23|(*ram_nb_of_points0_ptr&0x7FFFFF);
-                        //608
-                        events_base_ptr[19] = *ram_nb_of_points1_ptr;
-                        events_base_ptr[20] = *ram_nb_of_points2_ptr;
-                        events_base_ptr[21] = *ram_nb_of_points3_ptr;
-                        events_base_ptr[22] = *ram_nb_of_points4_ptr;
-                        events_base_ptr[23] = *ram_nb_of_points5_ptr;
-                        events_base_ptr[24] = *ram_nb_of_points6_ptr;
-                        events_base_ptr[25] = *ram_nb_of_points7_ptr;
-                        events_base_ptr[26] = nb_of_all_events;
-                        events_base_ptr[27] = nb_of_all_events;
-                        events_base_ptr[28] = nb_of_all_events;
-                        events_base_ptr[29] = nb_of_all_events;
-                        events_base_ptr[30] = nb_of_all_events;
-                        events_base_ptr[31] = nb_of_all_events;
-                        //next place is byte 128 (80h)
-                        events_base_ptr += 32;
-                        
-                        /*
-                        *events_base_ptr = event_buffer[0];
-                        *events_base_ptr = nb_of_all_events;
-                        events_base_ptr += 1;
-                        *events_base_ptr = 0;
-                        events_base_ptr += 1;
-                        */
-                        //printf("event %p : %lx \n", ram_func_ptr, *events_base_ptr);
-                        //prepare to the next addr in the ocr
-
-
-
-
-
-                        nb_of_events_treated++; 
-                        nb_of_all_events++;
-
-                        //printf("event treated : %d \n", nb_of_events_treated);
-
-                       
-
-                        //if the number of events treated is sufficient, send the 1st part of events.
-                        if (nb_of_events_treated == 128) {
-                            //nb_bytes_to_send = 128 * 128; //bytes per event * nb_event
-                            //nb_dma_transfer = 1;
-                                                        
-                            //ongoing transfer needs to finish first
-                            if (is_second_trans){
-                                while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0){
-                                }
-
-                                //reset the controls
-                                fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                                    FPGA_DMA_CONTROL,
-                                    FPGA_DMA_GO,
-                                    0);
-                                fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                                    FPGA_DMA_STATUS,
-                                    FPGA_DMA_DONE,
-                                    0);
-                            }
-
-                            //go again
-                            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                                FPGA_DMA_READADDRESS,
-                                (uint32_t)DMA_TRANSFER_1_SRC_DMAC);
-
-                            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                                FPGA_DMA_LENGTH,
-                                DMA_FULL_BURST_IN_BYTES);
-
-                            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                                FPGA_DMA_CONTROL,
-                                FPGA_DMA_GO,
-                                1);
-
-                            //printf("1 sending  %d events \n", nb_of_events_treated);
-                            is_second_trans = true;
-
-                            
-                        }
-
-
-                        //if there are still more events, send using 2nd part
-                        if (nb_of_events_treated == 256){
-                            //ongoing transfer needs to finish first
-                            while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-                            }
-                            
-                            //reset the controls
-                            fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                                FPGA_DMA_CONTROL,
-                                FPGA_DMA_GO,
-                                0);
-                            fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                                FPGA_DMA_STATUS,
-                                FPGA_DMA_DONE,
-                                0);
-                            //printf("2 src : %x\n", DMA_TRANSFER_2_SRC_DMAC);
-                            //go again
-                            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                                FPGA_DMA_READADDRESS,
-                                (uint32_t)DMA_TRANSFER_2_SRC_DMAC);
-
-                            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                                FPGA_DMA_LENGTH,
-                                DMA_FULL_BURST_IN_BYTES);
-
-                            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                                FPGA_DMA_CONTROL,
-                                FPGA_DMA_GO,
-                                1);
-                            
-                            //printf("2 sending  %d events\n", nb_of_events_treated);
-
-                            //reset the nb_events_treated
-                            nb_of_events_treated = 0;
-
-                            //reset the pointer
-                            events_base_ptr = (int_fast32_t*)events_base;
-                            
-                        }
-        
-                        // //if there are still more events, send using 3rd part
-                        // if (nb_of_events_treated == 384) {
-                            // //ongoing transfer needs to finish first
-                            // while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-                            // }
-                            // //reset the controls
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                                // FPGA_DMA_CONTROL,
-                                // FPGA_DMA_GO,
-                                // 0);
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                                // FPGA_DMA_STATUS,
-                                // FPGA_DMA_DONE,
-                                // 0);
-                            // //printf("3 src : %x\n", DMA_TRANSFER_3_SRC_DMAC);
-                            // //go again
-                            // fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                                // FPGA_DMA_READADDRESS,
-                                // (uint32_t)DMA_TRANSFER_3_SRC_DMAC);
-
-                            // fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                                // FPGA_DMA_LENGTH,
-                                // DMA_FULL_BURST_IN_BYTES);
-
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                                // FPGA_DMA_CONTROL,
-                                // FPGA_DMA_GO,
-                                // 1);
-
-                        // }
-
-                        // //if there are still more events, send using 4th part
-                        // if (nb_of_events_treated == 512) {
-                            // //ongoing transfer needs to finish first
-                            // while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-                            // }
-                            // //reset the controls
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                                // FPGA_DMA_CONTROL,
-                                // FPGA_DMA_GO,
-                                // 0);
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                                // FPGA_DMA_STATUS,
-                                // FPGA_DMA_DONE,
-                                // 0);
-                            // //printf("4 src : %x\n", DMA_TRANSFER_4_SRC_DMAC);
-                            // //go again
-                            // fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                                // FPGA_DMA_READADDRESS,
-                                // (uint32_t)DMA_TRANSFER_4_SRC_DMAC);
-
-                            // fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                                // FPGA_DMA_LENGTH,
-                                // DMA_FULL_BURST_IN_BYTES);
-
-                            // fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                                // FPGA_DMA_CONTROL,
-                                // FPGA_DMA_GO,
-                                // 1);
-
-                            // //printf("2 sending  %d events\n", nb_of_events_treated);
-
-                            // //reset the nb_events_treated
-                            // nb_of_events_treated = 0;
-
-                            // //reset the pointer
-                            // events_base_ptr = (int_fast32_t*)events_base;
-
-                        // }
-
-                        //update mod counters
-                        modded_scan_counters[O_1D] = scan_counters[_1D] % nb_elements_per_counter[O_1D];
-                        modded_scan_counters[O_2D] = scan_counters[_2D] % nb_elements_per_counter[O_2D];
-                        modded_scan_counters[O_3D] = scan_counters[_3D] % nb_elements_per_counter[O_3D];
-                        modded_scan_counters[O_4D] = scan_counters[_4D] % nb_elements_per_counter[O_4D];
-
-                        
-
-                        if ((*ram_func_ptr & 0xff) == 0x08) {
-                            ram_func_ptr                   = ram_func_base                   ;
-                            ram_ttl_ptr                    = ram_ttl_base                    ;
-                            ram_orders_ptr                 = ram_orders_base                 ;
-                            ram_adr_c1_ptr                 = ram_adr_c1_base                 ;
-                            ram_adr_c2_ptr                 = ram_adr_c2_base                 ;
-                            ram_adr_c3_ptr                 = ram_adr_c3_base                 ;
-                            ram_adr_c4_ptr                 = ram_adr_c4_base                 ;
-                            ram_adr_c1b_ptr                = ram_adr_c1b_base                ;
-                            ram_adr_c2b_ptr                = ram_adr_c2b_base                ;
-                            ram_adr_c3b_ptr                = ram_adr_c3b_base                ;
-                            ram_adr_c4b_ptr                = ram_adr_c4b_base                ;
-                            ram_nb_of_points0_ptr          = ram_nb_of_points0_base          ;
-                            ram_nb_of_points1_ptr          = ram_nb_of_points1_base          ;
-                            ram_nb_of_points2_ptr          = ram_nb_of_points2_base          ;
-                            ram_nb_of_points3_ptr          = ram_nb_of_points3_base          ;
-                            ram_nb_of_points4_ptr          = ram_nb_of_points4_base          ;
-                            ram_nb_of_points5_ptr          = ram_nb_of_points5_base          ;
-                            ram_nb_of_points6_ptr          = ram_nb_of_points6_base          ;
-                            ram_nb_of_points7_ptr          = ram_nb_of_points7_base          ;
-                            ram_smart_ttl_adr_att_ptr      = ram_smart_ttl_adr_att_base      ;
-                            ram_tx_shape_param1b_ptr       = ram_tx_shape_param1b_base       ;
-                            ram_tx_shape_param2b_ptr       = ram_tx_shape_param2b_base       ;
-                            ram_tx_shape_param3b_ptr       = ram_tx_shape_param3b_base       ;
-                            ram_tx_shape_param4b_ptr       = ram_tx_shape_param4b_base       ;
-                            ram_tx_shape_param1_ptr        = ram_tx_shape_param1_base        ;
-                            ram_tx_shape_param2_ptr        = ram_tx_shape_param2_base        ;
-                            ram_tx_shape_param3_ptr        = ram_tx_shape_param3_base        ;
-                            ram_tx_shape_param4_ptr        = ram_tx_shape_param4_base        ;
-                            ram_tx_phase_shape_param1_ptr  = ram_tx_phase_shape_param1_base  ;
-                            ram_tx_phase_shape_param2_ptr  = ram_tx_phase_shape_param2_base  ;
-                            ram_tx_phase_shape_param3_ptr  = ram_tx_phase_shape_param3_base  ;
-                            ram_tx_phase_shape_param4_ptr  = ram_tx_phase_shape_param4_base  ;
-                            ram_tx_phase_shape_param1b_ptr = ram_tx_phase_shape_param1b_base ;
-                            ram_tx_phase_shape_param2b_ptr = ram_tx_phase_shape_param2b_base ;
-                            ram_tx_phase_shape_param3b_ptr = ram_tx_phase_shape_param3b_base ;
-                            ram_tx_phase_shape_param4b_ptr = ram_tx_phase_shape_param4b_base ;
-                            
-                            
-                            
-                            
-                            
-                            
-                            
-                            
-                            
-                            
-                            
-                            break;
-                        }
-                        else {
-                            ram_func_ptr++;
-                            ram_ttl_ptr++;
-                            ram_orders_ptr++; 
-                            ram_adr_c1_ptr++; 
-                            ram_adr_c2_ptr++; 
-                            ram_adr_c3_ptr++; 
-                            ram_adr_c4_ptr++; 
-                            ram_adr_c1b_ptr++; 
-                            ram_adr_c2b_ptr++; 
-                            ram_adr_c3b_ptr++; 
-                            ram_adr_c4b_ptr++; 
-                            ram_nb_of_points0_ptr++;
-                            ram_nb_of_points1_ptr++;
-                            ram_nb_of_points2_ptr++;
-                            ram_nb_of_points3_ptr++;
-                            ram_nb_of_points4_ptr++;
-                            ram_nb_of_points5_ptr++;
-                            ram_nb_of_points6_ptr++;
-                            ram_nb_of_points7_ptr++;
-                            ram_smart_ttl_adr_att_ptr++;
-                            ram_tx_shape_param1b_ptr++;
-                            ram_tx_shape_param2b_ptr++;
-                            ram_tx_shape_param3b_ptr++;
-                            ram_tx_shape_param4b_ptr++;
-                            ram_tx_shape_param1_ptr++;
-                            ram_tx_shape_param2_ptr++;
-                            ram_tx_shape_param3_ptr++;
-                            ram_tx_shape_param4_ptr++;
-                            ram_tx_phase_shape_param1_ptr++;
-                            ram_tx_phase_shape_param2_ptr++;
-                            ram_tx_phase_shape_param3_ptr++;
-                            ram_tx_phase_shape_param4_ptr++;
-                            ram_tx_phase_shape_param1b_ptr++;
-                            ram_tx_phase_shape_param2b_ptr++;
-                            ram_tx_phase_shape_param3b_ptr++;
-                            ram_tx_phase_shape_param4b_ptr++;
-                        }
-
-
-                    }
-
-                }
-            }
+void events_abort(void) {
+    pthread_mutex_lock(&streams_mutex);
+    streams_aborted = true;
+    for (int i = 0; i < 2; i++) {
+        if (open_streams[i] != NULL) {
+            stream_abort(open_streams[i]);
         }
     }
+    pthread_mutex_unlock(&streams_mutex);
+}
 
-    printf("events treated left  : %d \n", nb_of_events_treated);
+void events_abort_clear(void) {
+    pthread_mutex_lock(&streams_mutex);
+    streams_aborted = false;
+    pthread_mutex_unlock(&streams_mutex);
+}
 
-    //maybe we have something to transfer still
-    if (nb_of_events_treated != 0){
-        //if the last one is bigger than 384 but less than 512 = 3rd zone
-        if (nb_of_events_treated > 384) {
-            while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-            }
+void events_ready_reset(uint32_t prefill) {
+    pthread_mutex_lock(&streams_mutex);
+    ready_prefill = prefill;
+    run_prefilled = prefill == 0;
+    run_over = false;
+    run_feeding = false;
+    pthread_mutex_unlock(&streams_mutex);
+}
+
+void events_ready_end(bool completed) {
+    pthread_mutex_lock(&streams_mutex);
+    run_prefilled = run_prefilled || completed;
+    run_over = true;
+    pthread_cond_broadcast(&ready_cond);
+    pthread_mutex_unlock(&streams_mutex);
+}
+
+bool events_wait_ready(int timeout_ms) {
+    pthread_mutex_lock(&streams_mutex);
+    //the analysis of the sequence may walk all its events, it is not part of the timeout
+    while (!run_feeding && !run_prefilled && !run_over) {
+        pthread_cond_wait(&ready_cond, &streams_mutex);
+    }
+
+    struct timespec deadline;
+    deadline_in_ms(&deadline, timeout_ms);
+    int result = 0;
+    while (!run_prefilled && !run_over && result == 0) {
+        result = timeout_ms > 0 ? pthread_cond_timedwait(&ready_cond, &streams_mutex, &deadline)
+            : pthread_cond_wait(&ready_cond, &streams_mutex);
+    }
+    bool ready = run_prefilled;
+    pthread_mutex_unlock(&streams_mutex);
+
+    if (!ready) {
+        log_error("Events not ready: %s", result != 0 ? "timeout" : "the run ended before the prefill");
+    }
+    return ready;
+}
 
-            //reset the controls
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                0);
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                FPGA_DMA_STATUS,
-                FPGA_DMA_DONE,
-                0);
-            //go again
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                FPGA_DMA_READADDRESS,
-                (uint32_t)DMA_TRANSFER_4_SRC_DMAC);
-
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                FPGA_DMA_LENGTH,
-                (nb_of_events_treated-384) * 128);
-
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                1);
+//the slot of a descriptor can be refilled once it reached the fifo, and the run is ready
+//once every stream has its prefill there
+static void slot_transferred(dma_descriptor_t* descriptor) {
+    stream_t* stream = (stream_t*)descriptor->context;
+    if (stream->mode == STREAM_RING) {
+        event_ring_release(&stream->ring);
+    }
+    if (descriptor->status != DMA_TRANSFER_DONE) {
+        return;
+    }
 
+    pthread_mutex_lock(&streams_mutex);
+    stream->nb_transferred += descriptor->length / stream->event_bytes;
+    bool prefilled = !run_over;
+    for (int i = 0; i < 2; i++) {
+        if (open_streams[i] != NULL && open_streams[i]->nb_transferred < open_streams[i]->prefill) {
+            prefilled = false;
         }
-        else if (nb_of_events_treated > 256) {
-            while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-            }
+    }
+    if (prefilled && !run_prefilled) {
+        run_prefilled = true;
+        pthread_cond_broadcast(&ready_cond);
+    }
+    pthread_mutex_unlock(&streams_mutex);
+}
+
+static stream_mode_t stream_mode(const event_target_t* target, const event_compiler_t* compiler, uint32_t event_bytes) {
+    event_cache_t* cache = target->cache;
+    if (cache == NULL || compiler->generation == 0 || compiler->nb_events * event_bytes > cache->bytes) {
+        return STREAM_RING;
+    }
+    if (cache->generation == compiler->generation) {
+        return STREAM_CACHE_REPLAY;
+    }
+    //the generation of the cache is newer than any change of the structure
+    if (cache->patchable && cache->generation != 0 && compiler->structure_generation <= cache->generation) {
+        return STREAM_CACHE_PATCH;
+    }
+    return STREAM_CACHE_FILL;
+}
+
+//drops the events of the cache, they are about to be overwritten
+static void cache_invalidate(event_cache_t* cache) {
+    cache->generation = 0;
+    if (cache->patchable) {
+        cache->patchable = false;
+        event_patch_destroy(&cache->patch);
+    }
+}
+
+//updates the elements of the cache, falls back on compiling it again
+static stream_mode_t cache_patch(event_cache_t* cache, const event_compiler_t* compiler, const char* name) {
+    long long start = monotonic_us();
+    uint64_t nb_words;
+
+    //an interrupted patch leaves the cache invalid
+    uint64_t generation = cache->generation;
+    cache->generation = 0;
+    if (!event_patch_apply(&cache->patch, compiler, cache->base, &nb_words)) {
+        cache_invalidate(cache);
+        return STREAM_CACHE_FILL;
+    }
+    cache->generation = compiler->generation;
+
+    log_info("%s events cache patched from generation %llu to %llu: %llu words in %lld us", name,
+        (unsigned long long)generation, (unsigned long long)compiler->generation, (unsigned long long)nb_words, monotonic_us() - start);
+    return STREAM_CACHE_REPLAY;
+}
 
-            //reset the controls
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                0);
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                FPGA_DMA_STATUS,
-                FPGA_DMA_DONE,
-                0);
-            //go again
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                FPGA_DMA_READADDRESS,
-                (uint32_t)DMA_TRANSFER_3_SRC_DMAC);
-
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                FPGA_DMA_LENGTH,
-                (nb_of_events_treated-256) * 128);
-
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                1);
+static bool stream_open(stream_t* stream, const char* name, const event_target_t* target, stream_mode_t mode,
+    const event_compiler_t* compiler, uint32_t slot_bytes, uint32_t event_bytes) {
+    memset(stream, 0, sizeof(stream_t));
+    if (mode == STREAM_CACHE_PATCH) {
+        long long start = monotonic_us();
+        mode = cache_patch(target->cache, compiler, name);
+        stream->compile_us = monotonic_us() - start;
+    }
+    stream->name = name;
+    stream->mode = mode;
+    stream->cache = target->cache;
+    stream->generation = compiler->generation;
+    stream->slot_bytes = slot_bytes;
+    stream->event_bytes = event_bytes;
+
+    uint32_t nb_slots = MINIMUM(MAXIMUM(config_event_ring_slots(), 2), target->window_bytes / slot_bytes);
+    stream->nb_descriptors = nb_slots;
+    if (mode != STREAM_RING) {
+        uint64_t bytes = compiler->nb_events * event_bytes;
+        stream->nb_descriptors = MAXIMUM((bytes + slot_bytes - 1) / slot_bytes, 1);
+    }
+    stream->descriptors = calloc(stream->nb_descriptors, sizeof(dma_descriptor_t));
+    if (stream->descriptors == NULL) {
+        log_error("Unable to allocate %s dma descriptors", name);
+        return false;
+    }
+
+    if (!event_ring_init(&stream->ring, target->window, target->window_address, slot_bytes, nb_slots)) {
+        free(stream->descriptors);
+        return false;
+    }
+
+    if (!dma_engine_init(&stream->engine, name, target->dmac, nb_slots)) {
+        event_ring_destroy(&stream->ring);
+        free(stream->descriptors);
+        return false;
+    }
+
+    //the previous events are overwritten from the first slot on
+    if (mode == STREAM_CACHE_FILL) {
+        cache_invalidate(stream->cache);
+    }
+    stream_register(stream, compiler->nb_events);
+    return true;
+}
+
+//next slot to fill, NULL if the stream has been aborted.
+//Several slots can be acquired before being submitted, in the same order.
+static uint32_t* stream_acquire(stream_t* stream) {
+    if (stream->mode == STREAM_RING) {
+        uint32_t address;
+        return event_ring_acquire_free(&stream->ring, &address);
+    }
+
+    uint32_t offset = stream->nb_acquired++ * stream->slot_bytes;
+    return (uint32_t*)((uint8_t*)stream->cache->base + offset);
+}
+
+//hands the oldest acquired slot, filled with nb_events, to the dma
+static bool stream_submit(stream_t* stream, uint32_t nb_events) {
+    dma_descriptor_t* descriptor = &stream->descriptors[stream->nb_submitted % stream->nb_descriptors];
+    descriptor->length = nb_events * stream->event_bytes;
+    descriptor->completion = slot_transferred;
+    descriptor->context = stream;
+    if (stream->mode == STREAM_RING) {
+        descriptor->source = event_ring_commit(&stream->ring);
+    }
+    else {
+        descriptor->source = stream->cache->base_address + stream->nb_submitted * stream->slot_bytes;
+    }
+    stream->nb_submitted++;
+
+    if (!dma_engine_submit(&stream->engine, descriptor)) {
+        return false;
+    }
+    stream->nb_events += nb_events;
+    return true;
+}
+
+//sends the next slot of the cache, false once all of them are sent
+static bool stream_replay(stream_t* stream) {
+    uint32_t remaining = stream->cache->nb_events - stream->nb_events;
+    if (remaining == 0) {
+        return false;
+    }
+
+    stream_acquire(stream);
+    return stream_submit(stream, MINIMUM(remaining, stream->slot_bytes / stream->event_bytes));
+}
+
+//waits for the last slots to be sent, a filled cache is kept if the whole sequence made it
+static void stream_finish(stream_t* stream, const event_compiler_t* compiler, events_report_t* report) {
+    bool success = dma_engine_wait_idle(&stream->engine);
+    if (!success) {
+        log_error("%s events stream interrupted after %u events", stream->name, stream->nb_events);
+    }
+    else if (stream->mode == STREAM_CACHE_FILL && stream->nb_events == compiler->nb_events) {
+        event_cache_t* cache = stream->cache;
+        cache->nb_events = stream->nb_events;
+        cache->generation = stream->generation;
+        cache->patchable = event_patch_init(&cache->patch, compiler,
+            stream->event_bytes == EVENT_RF_BYTES ? EVENT_STREAM_RF : EVENT_STREAM_GRAD);
+    }
+
+    dma_engine_stats_t stats;
+    dma_engine_get_stats(&stream->engine, &stats);
+    log_info("%s dma%s: %u transfers, %llu bytes, busy %lld us, starved %lld us, longest transfer %lld us",
+        stream->name, stream->mode == STREAM_CACHE_REPLAY ? " from cache" : "",
+        stats.transfers, (unsigned long long)stats.bytes, stats.busy_us, stats.starved_us, stats.max_transfer_us);
+
+    report->dma_bytes += stats.bytes;
+    report->dma_stall_us = MAXIMUM(report->dma_stall_us, stats.starved_us);
+    report->compile_us += stream->compile_us;
+}
+
+//also the cleanup handler when the compiling thread is cancelled, the engine must not keep on polling the dmac
+static void stream_close(void* arg) {
+    stream_t* stream = (stream_t*)arg;
+    stream_unregister(stream);
+    event_ring_abort(&stream->ring);
+    dma_engine_destroy(&stream->engine);
+    event_ring_destroy(&stream->ring);
+    free(stream->descriptors);
+}
+
+static void compile_pool_close(void* pool) {
+    compile_pool_destroy((compile_pool_t*)pool);
+}
+
+//compiles the slots of stream, and of grad when both come from the same pass, then sends them one after the other
+static void stream_compile_serial(event_compiler_t* compiler, stream_t* stream, stream_t* grad, uint32_t events_per_slot) {
+    //in the ring, the compiler runs up to nb_slots - 1 slots ahead of the transfer in progress
+    uint32_t *slot, *grad_slot = NULL;
+    while ((slot = stream_acquire(stream)) != NULL && (grad == NULL || (grad_slot = stream_acquire(grad)) != NULL)) {
+        long long start = monotonic_us();
+        uint32_t count = grad == NULL ? event_compiler_fill(compiler, slot, events_per_slot)
+            : event_compiler_fill_both(compiler, slot, grad_slot, events_per_slot);
+        stream->compile_us += monotonic_us() - start;
+        if (count == 0 || !stream_submit(stream, count) || (grad != NULL && !stream_submit(grad, count))) {
+            break;
         }
-        else if (nb_of_events_treated > 128) {
-            while (fpga_dma_read_bit(FPGA_DMA_vaddr_void, FPGA_DMA_STATUS, FPGA_DMA_DONE) == 0) {
-            }
+    }
+}
+
+//same with nb_threads workers compiling slots at once, each slot being sent in scan order once it is ready.
+//returns false if the workers could not be started.
+static bool stream_compile_parallel(event_compiler_t* compiler, stream_t* stream, stream_t* grad, uint32_t events_per_slot, uint32_t nb_threads) {
+    //a ring slot is only released once sent, the workers can have all of them at once
+    uint32_t depth = 2 * nb_threads;
+    if (stream->mode == STREAM_RING) {
+        depth = stream->ring.nb_slots;
+    }
+    if (grad != NULL && grad->mode == STREAM_RING) {
+        depth = MINIMUM(depth, grad->ring.nb_slots);
+    }
+
+    compile_pool_t pool;
+    if (!compile_pool_init(&pool, compiler, nb_threads, depth)) {
+        return false;
+    }
+    pthread_cleanup_push(compile_pool_close, &pool);
+
+    bool posting = true;
+    bool sending = true;
+    while (sending) {
+        while (posting && compile_pool_pending(&pool) < depth) {
+            uint32_t *slot, *grad_slot = NULL;
+            posting = (slot = stream_acquire(stream)) != NULL
+                && (grad == NULL || (grad_slot = stream_acquire(grad)) != NULL)
+                && compile_pool_post(&pool, slot, grad_slot, events_per_slot) > 0;
+        }
+        if (compile_pool_pending(&pool) == 0) {
+            break;
+        }
+
+        uint32_t count = compile_pool_wait(&pool);
+        sending = stream_submit(stream, count) && (grad == NULL || stream_submit(grad, count));
+    }
+
+    pthread_cleanup_pop(1);
+    stream->compile_us += pool.compile_us;
+    return true;
+}
+
+//compiles the slots of stream, and of grad, with config_compile_threads() threads
+static void stream_compile(event_compiler_t* compiler, stream_t* stream, stream_t* grad, uint32_t events_per_slot) {
+    uint32_t nb_threads = config_compile_threads();
+    //a loop program is run again from its start to seek the first event of each slab
+    if (compiler->program.code != NULL) {
+        nb_threads = 1;
+    }
+    if (nb_threads < 2 || !stream_compile_parallel(compiler, stream, grad, events_per_slot, nb_threads)) {
+        stream_compile_serial(compiler, stream, grad, events_per_slot);
+    }
+}
+
+//the whole sequence made it to the fifo
+static void report_done(events_report_t* report, const event_compiler_t* compiler, uint32_t nb_events, long long start) {
+    report->nb_events = nb_events;
+    report->completed = nb_events == compiler->nb_events;
+    report->elapsed_us = monotonic_us() - start;
+}
+
+uint32_t stream_events_to_fpga(event_compiler_t* compiler, const event_target_t* target, uint32_t slot_bytes, events_report_t* report) {
+    uint32_t event_bytes = event_compiler_event_words(compiler) * 4;
+    uint32_t events_per_slot = slot_bytes / event_bytes;
+    stream_mode_t mode = stream_mode(target, compiler, event_bytes);
+    long long start = monotonic_us();
+    memset(report, 0, sizeof(events_report_t));
+
+    stream_t stream;
+    if (!stream_open(&stream, compiler->stream == EVENT_STREAM_RF ? "RF" : "gradient", target, mode, compiler, slot_bytes, event_bytes)) {
+        return 0;
+    }
+    pthread_cleanup_push(stream_close, &stream);
+
+    if (stream.mode == STREAM_CACHE_REPLAY) {
+        while (stream_replay(&stream)) {
+        }
+    }
+    else {
+        stream_compile(compiler, &stream, NULL, events_per_slot);
+    }
+    stream_finish(&stream, compiler, report);
+
+    pthread_cleanup_pop(1);
+    report_done(report, compiler, stream.nb_events, start);
+    return stream.nb_events;
+}
+
+uint32_t stream_dual_events_to_fpga(event_compiler_t* compiler, const event_target_t* rf, const event_target_t* grad, uint32_t events_per_slot,
+    events_report_t* report) {
+    long long start = monotonic_us();
+    memset(report, 0, sizeof(events_report_t));
+
+    //both streams come from the same pass, they are either both cached or both compiled into their ring
+    stream_mode_t rf_mode = stream_mode(rf, compiler, EVENT_RF_BYTES);
+    stream_mode_t grad_mode = stream_mode(grad, compiler, EVENT_GRAD_BYTES);
+    if (rf_mode == STREAM_RING || grad_mode == STREAM_RING) {
+        rf_mode = grad_mode = STREAM_RING;
+    }
+    else if (rf_mode == STREAM_CACHE_FILL || grad_mode == STREAM_CACHE_FILL) {
+        rf_mode = grad_mode = STREAM_CACHE_FILL;
+    }
+
+    stream_t rf_stream, grad_stream;
+    uint32_t nb_of_all_events = 0;
+    if (!stream_open(&rf_stream, "RF", rf, rf_mode, compiler, events_per_slot * EVENT_RF_BYTES, EVENT_RF_BYTES)) {
+        return 0;
+    }
+    pthread_cleanup_push(stream_close, &rf_stream);
 
-            //reset the controls
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                0);
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void, //clean the done bit
-                FPGA_DMA_STATUS,
-                FPGA_DMA_DONE,
-                0);
-            //go again
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                FPGA_DMA_READADDRESS,
-                (uint32_t)DMA_TRANSFER_2_SRC_DMAC);
-
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                FPGA_DMA_LENGTH,
-                (nb_of_events_treated-128) * 128);
-
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                1);
+    //a patch which could not be applied leaves the other stream of the pass to compile as well
+    if (rf_stream.mode == STREAM_CACHE_FILL) {
+        grad_mode = STREAM_CACHE_FILL;
+    }
+    if (stream_open(&grad_stream, "gradient", grad, grad_mode, compiler, events_per_slot * EVENT_GRAD_BYTES, EVENT_GRAD_BYTES)) {
+        pthread_cleanup_push(stream_close, &grad_stream);
+
+        if (rf_stream.mode == STREAM_CACHE_REPLAY && grad_stream.mode == STREAM_CACHE_REPLAY) {
+            //alternate between the two dmacs so they both run
+            bool rf_pending = true, grad_pending = true;
+            while (rf_pending || grad_pending) {
+                rf_pending = rf_pending && stream_replay(&rf_stream);
+                grad_pending = grad_pending && stream_replay(&grad_stream);
+            }
         }
         else {
-            //go again
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void,   //set source address
-                FPGA_DMA_READADDRESS,
-                (uint32_t)DMA_TRANSFER_1_SRC_DMAC);
-
-            fpga_dma_write_reg(FPGA_DMA_vaddr_void, //set transfer size
-                FPGA_DMA_LENGTH,
-                nb_of_events_treated * 128);
-
-            fpga_dma_write_bit(FPGA_DMA_vaddr_void,//start transfer
-                FPGA_DMA_CONTROL,
-                FPGA_DMA_GO,
-                1);
+            stream_compile(compiler, &rf_stream, &grad_stream, events_per_slot);
         }
+        stream_finish(&rf_stream, compiler, report);
+        stream_finish(&grad_stream, compiler, report);
+        nb_of_all_events = MINIMUM(rf_stream.nb_events, grad_stream.nb_events);
+
+        pthread_cleanup_pop(1);
+    }
+
+    pthread_cleanup_pop(1);
+    report_done(report, compiler, nb_of_all_events, start);
+    return nb_of_all_events;
+}
+
+event_cache_t* event_cache_view(event_cache_t* cache, ddr_area_id_t area, uint32_t item) {
+    if (!config_event_cache()) {
+        return NULL;
+    }
+
+    if (cache->base == NULL) {
+        cache->bytes = ddr_area(area)->item_bytes;
+        cache->base = ddr_view(area, item, 0, cache->bytes);
+        cache->base_address = ddr_address(area, item);
     }
+    return cache->base != NULL ? cache : NULL;
+}
+
+//one cache per stream for each bank of the sequence rams
+static event_cache_t caches[2][SEQUENCE_RAM_BANKS];
 
+event_cache_t* event_cache_bank(event_stream_t stream, uint32_t bank) {
+    return event_cache_view(&caches[stream][bank], stream == EVENT_STREAM_RF ? DDR_RF_EVENTS_CACHE : DDR_GRAD_EVENTS_CACHE, bank);
+}
+
+bool event_target_window(event_target_t* target, ddr_area_id_t window) {
+    //mapped once at startup by shared_memory_map_regions()
+    target->window_bytes = ddr_area(window)->item_bytes;
+    target->window = ddr_view(window, 0, 0, target->window_bytes);
+    target->window_address = ddr_address(window, 0);
+    return target->window != NULL;
+}
+
+bool event_target_rf(event_target_t* target) {
+    bool mapped = event_target_window(target, DDR_RF_EVENTS_WINDOW);
+    target->dmac = shared_memory_view(REGION_LW_BRIDGE, LW_BASE + FPGA_DMAC_QSYS_ADDRESS, FPGA_DMA_REGISTERS_SPAN);
+    target->cache = event_cache_bank(EVENT_STREAM_RF, sequence_rams_active_bank());
+    return mapped && target->dmac != NULL;
+}
 
+bool events_upload(event_stream_t stream, uint32_t offset, const void* data, uint32_t nbytes) {
+    uint32_t event_bytes = stream == EVENT_STREAM_RF ? EVENT_RF_BYTES : EVENT_GRAD_BYTES;
+    if (offset % event_bytes != 0 || nbytes % event_bytes != 0) {
+        log_error("Unable to upload %u bytes of events at %u, not whole events of %u bytes", nbytes, offset, event_bytes);
+        return false;
+    }
 
+    uint32_t bank = sequence_rams_active_bank();
+    event_cache_t* cache = event_cache_bank(stream, bank);
+    if (cache == NULL || (uint64_t)offset + nbytes > cache->bytes) {
+        log_error("Unable to upload %u bytes of events at %u, the events cache is %s", nbytes, offset,
+            cache == NULL ? "disabled" : "too small");
+        return false;
+    }
 
+    pthread_mutex_lock(&streams_mutex);
+    if (!uploaded.active || uploaded.bank != bank) {
+        uploaded.bytes[EVENT_STREAM_RF] = uploaded.bytes[EVENT_STREAM_GRAD] = 0;
+    }
+    uint32_t expected = offset == 0 ? 0 : uploaded.bytes[stream];
+    if (offset == expected) {
+        uploaded.bytes[stream] = offset;
+        uploaded.active = true;
+        uploaded.bank = bank;
+    }
+    pthread_mutex_unlock(&streams_mutex);
 
+    if (offset != expected) {
+        log_error("Events upload at %u, expected the next chunk at %u", offset, expected);
+        return false;
+    }
 
+    //whatever was compiled there is overwritten
+    if (offset == 0) {
+        cache_invalidate(cache);
+    }
+    memcpy((uint8_t*)cache->base + offset, data, nbytes);
 
+    pthread_mutex_lock(&streams_mutex);
+    uploaded.bytes[stream] += nbytes;
+    pthread_mutex_unlock(&streams_mutex);
+    return true;
+}
 
+void events_upload_clear(void) {
+    pthread_mutex_lock(&streams_mutex);
+    uploaded.active = false;
+    pthread_mutex_unlock(&streams_mutex);
+}
 
+bool events_uploaded(void) {
+    pthread_mutex_lock(&streams_mutex);
+    bool active = uploaded.active;
+    pthread_mutex_unlock(&streams_mutex);
+    return active;
+}
 
+uint32_t send_uploaded_events(events_report_t* report) {
+    memset(report, 0, sizeof(events_report_t));
+    pthread_mutex_lock(&streams_mutex);
+    uint32_t bank = uploaded.bank;
+    uint32_t rf_events = uploaded.bytes[EVENT_STREAM_RF] / EVENT_RF_BYTES;
+    uint32_t grad_events = uploaded.bytes[EVENT_STREAM_GRAD] / EVENT_GRAD_BYTES;
+    pthread_mutex_unlock(&streams_mutex);
+
+    event_target_t rf, grad;
+    if (!event_target_rf(&rf) || !event_target_grad(&grad)) {
+        return 0;
+    }
+    //the gradient events are optional, but come from the same sequence
+    if (rf_events == 0 || (grad_events != 0 && grad_events != rf_events)) {
+        log_error("Uploaded events not sent: %u RF events and %u gradient events", rf_events, grad_events);
+        return 0;
+    }
 
+    //the uploaded caches are replayed, only the number of events of the compiler is used
+    event_compiler_t compiler;
+    memset(&compiler, 0, sizeof(event_compiler_t));
+    compiler.stream = EVENT_STREAM_RF;
+    compiler.nb_events = rf_events;
+    compiler.generation = UPLOADED_GENERATION;
+    rf.cache = event_cache_bank(EVENT_STREAM_RF, bank);
+    rf.cache->nb_events = rf_events;
+    rf.cache->generation = UPLOADED_GENERATION;
+
+    uint32_t nb_events;
+    if (grad_events == 0) {
+        nb_events = stream_events_to_fpga(&compiler, &rf, DMA_FULL_BURST_IN_BYTES, report);
+        log_events_report("uploaded RF", report);
+    }
+    else {
+        grad.cache = event_cache_bank(EVENT_STREAM_GRAD, bank);
+        grad.cache->nb_events = grad_events;
+        grad.cache->generation = UPLOADED_GENERATION;
+        nb_events = stream_dual_events_to_fpga(&compiler, &rf, &grad, DMA_FULL_BURST_IN_BYTES / EVENT_RF_BYTES, report);
+        log_events_report("uploaded RF and gradient", report);
+    }
+    return nb_events;
+}
 
+void log_events_report(const char* name, const events_report_t* report) {
+    long long elapsed = report->elapsed_us;
+    log_info("%u %s events %s in %lld us (%.0f events/s): compile %lld us, dma stalled %lld us, %llu bytes sent",
+        report->nb_events, name, report->completed ? "sent" : "sent before an abort", elapsed,
+        elapsed > 0 ? report->nb_events * 1e6 / elapsed : 0.0,
+        report->compile_us, report->dma_stall_us, (unsigned long long)report->dma_bytes);
+}
 
+uint32_t create_events(void) {
+    event_target_t target;
+    sequence_source_t source;
+    event_compiler_t compiler;
+    if (!event_target_rf(&target) || !sequence_rams_source(&source) || !event_compiler_init(&compiler, &source, EVENT_STREAM_RF)) {
+        return 0;
+    }
 
+    events_report_t report;
+    uint32_t nb_of_all_events = stream_events_to_fpga(&compiler, &target, DMA_FULL_BURST_IN_BYTES, &report);
+    event_compiler_destroy(&compiler);
 
+    log_events_report("RF", &report);
+    return nb_of_all_events;
+}
 
+static void sequence_analytics(const event_compiler_t* compiler, event_analytics_t* analytics) {
+    pthread_mutex_lock(&analytics_mutex);
+    for (uint32_t i = 0; i < SEQUENCE_RAM_BANKS; i++) {
+        if (compiler->generation != 0 && analyzed[i].generation == compiler->generation) {
+            *analytics = analyzed[i];
+            pthread_mutex_unlock(&analytics_mutex);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&analytics_mutex);
+
+    long long start = monotonic_us();
+    event_compiler_analyze(compiler, analytics);
+
+    double duration = MAXIMUM(analytics->duration, 1);
+    log_info("Sequence of %llu events, %llu timer ticks, analyzed in %lld us: TX duty %.2f/%.2f/%.2f/%.2f %%, "
+        "TX energy %.3g/%.3g/%.3g/%.3g, TTL active %.2f %%",
+        (unsigned long long)analytics->nb_events, (unsigned long long)analytics->duration, monotonic_us() - start,
+        100 * analytics->tx_on[0] / duration, 100 * analytics->tx_on[1] / duration,
+        100 * analytics->tx_on[2] / duration, 100 * analytics->tx_on[3] / duration,
+        analytics->tx_energy[0], analytics->tx_energy[1], analytics->tx_energy[2], analytics->tx_energy[3],
+        100 * analytics->ttl_on / duration);
+
+    pthread_mutex_lock(&analytics_mutex);
+    analyzed[analyzed_next] = *analytics;
+    analyzed_next = (analyzed_next + 1) % SEQUENCE_RAM_BANKS;
+    pthread_mutex_unlock(&analytics_mutex);
+}
 
-    /*
-    for (int i = 0; i < _4D; i++) {
-        printf("counters %d at %x \n", i, scan_counters[i]);
+bool events_within_limits(const event_compiler_t* compiler, events_report_t* report) {
+    double limit = config_rf_duty_limit();
+    report->duty = 0;
+    report->duty_exceeded = 0;
+    if (!config_sequence_analytics() && limit <= 0) {
+        return true;
     }
 
+    event_analytics_t analytics;
+    sequence_analytics(compiler, &analytics);
+    for (int tx = 0; tx < SEQ_NB_OF_TX; tx++) {
+        double duty = 100.0 * analytics.tx_on[tx] / MAXIMUM(analytics.duration, 1);
+        report->duty = MAXIMUM(report->duty, duty);
+        if (limit > 0 && duty > limit) {
+            report->duty_exceeded |= 1u << tx;
+        }
+    }
 
-    printf("\n nb of events to transfer %d \n", nb_of_all_events);
-    */
+    if (report->duty_exceeded != 0) {
+        log_error("Sequence rejected: TX duty cycle of %.2f %% over the limit of %.2f %% (TX mask 0x%x)",
+            report->duty, limit, report->duty_exceeded);
+        return false;
+    }
+    return true;
+}
 
-    // --------------clean up our memory mapping and exit -----------------//
-    if (munmap(events_base, DDR_EVENTS_SPAN) != 0) {
-        printf("ERROR: munmap() events_base failed...\n");
-        close(fd);
-        return(1);
+uint32_t create_events_dual(events_report_t* report) {
+    event_target_t rf, grad;
+    sequence_source_t source;
+    event_compiler_t compiler;
+    memset(report, 0, sizeof(events_report_t));
+    if (!event_target_rf(&rf) || !event_target_grad(&grad)
+        || !sequence_rams_source(&source) || !event_compiler_init(&compiler, &source, EVENT_STREAM_RF)) {
+        return 0;
+    }
+    //rather than failing halfway through
+    if (!events_within_limits(&compiler, report)) {
+        event_compiler_destroy(&compiler);
+        return 0;
     }
 
-    //return 0;
+    //a full RF burst per slot, the gradient slots are half as big
+    double duty = report->duty;
+    uint32_t nb_of_all_events = stream_dual_events_to_fpga(&compiler, &rf, &grad, DMA_FULL_BURST_IN_BYTES / EVENT_RF_BYTES, report);
+    report->duty = duty;
+    event_compiler_destroy(&compiler);
+
+    log_events_report("RF and gradient", report);
     return nb_of_all_events;
+}
+
+//compiles the whole sequence into both caches, false if cancelled before the end
+static bool cache_fill_both(event_compiler_t* compiler, event_cache_t* rf, event_cache_t* grad, const volatile bool* cancel) {
+    cache_invalidate(rf);
+    cache_invalidate(grad);
+
+    uint32_t events_per_slot = DMA_FULL_BURST_IN_BYTES / EVENT_RF_BYTES;
+    uint32_t nb_events = 0;
+    uint32_t count;
+    do {
+        if (*cancel) {
+            return false;
+        }
+        count = event_compiler_fill_both(compiler, (uint32_t*)((uint8_t*)rf->base + nb_events * EVENT_RF_BYTES),
+            (uint32_t*)((uint8_t*)grad->base + nb_events * EVENT_GRAD_BYTES), events_per_slot);
+        nb_events += count;
+    } while (count > 0);
+
+    if (nb_events != compiler->nb_events) {
+        return false;
+    }
+    rf->nb_events = grad->nb_events = nb_events;
+    rf->generation = grad->generation = compiler->generation;
+    rf->patchable = event_patch_init(&rf->patch, compiler, EVENT_STREAM_RF);
+    grad->patchable = event_patch_init(&grad->patch, compiler, EVENT_STREAM_GRAD);
+    return true;
+}
+
+bool precompile_staged_events(uint32_t bank, const volatile bool* cancel) {
+    long long start = monotonic_us();
+    event_cache_t* rf = event_cache_bank(EVENT_STREAM_RF, bank);
+    event_cache_t* grad = event_cache_bank(EVENT_STREAM_GRAD, bank);
+    sequence_source_t source;
+    event_compiler_t compiler;
+    if (rf == NULL || grad == NULL || !sequence_rams_staged_source(&source) || !event_compiler_init(&compiler, &source, EVENT_STREAM_RF)) {
+        return false;
+    }
+
+    //as the first run would: nothing to do if already there, a patch when only element values changed
+    event_target_t rf_target = { .cache = rf };
+    event_target_t grad_target = { .cache = grad };
+    stream_mode_t rf_mode = stream_mode(&rf_target, &compiler, EVENT_RF_BYTES);
+    stream_mode_t grad_mode = stream_mode(&grad_target, &compiler, EVENT_GRAD_BYTES);
+    if (rf_mode == STREAM_CACHE_PATCH) {
+        rf_mode = cache_patch(rf, &compiler, "RF staged");
+    }
+    if (grad_mode == STREAM_CACHE_PATCH) {
+        grad_mode = cache_patch(grad, &compiler, "gradient staged");
+    }
 
-}
\ No newline at end of file
+    bool success = rf_mode != STREAM_RING && grad_mode != STREAM_RING;
+    if (success && (rf_mode == STREAM_CACHE_FILL || grad_mode == STREAM_CACHE_FILL)) {
+        success = cache_fill_both(&compiler, rf, grad, cancel);
+    }
+    if (success) {
+        log_info("%llu staged events of bank %u precompiled in %lld us", (unsigned long long)compiler.nb_events, bank, monotonic_us() - start);
+    }
+    else {
+        log_warning("Staged events of bank %u not precompiled, they are compiled by the first run", bank);
+    }
+    //the first run then finds the analytics of the staged sequence
+    if (!*cancel) {
+        events_report_t report;
+        events_within_limits(&compiler, &report);
+    }
+    event_compiler_destroy(&compiler);
+    return success;
+}
@@ -8,12 +8,121 @@
 #include <fcntl.h>    //open()
 #include <sys/mman.h> //mmap()
 
+#include "event_compiler.h"
+#include "ddr_layout.h"
+
 #define HPS_RESERVED_ADDRESS    1073741824 
 #define HPS_RESERVED_SPAN       (524288000)     //500Megabytes
 
 #define STEP_32b_RAM            131072
 
+//Compiled events kept in the reserved DDR. While the sequence RAMs keep the same generation,
+//the events are sent again from there instead of being compiled. When only element RAMs changed,
+//the events are patched in place first.
+typedef struct {
+    void* base;
+    uint32_t base_address;      //physical, as seen by the dmac
+    uint32_t bytes;
+    uint64_t generation;        //of the sequence compiled in the cache, 0 if there is none
+    uint32_t nb_events;
+    bool patchable;             //patch is set, the cache can be updated for new element values
+    event_patch_t patch;
+} event_cache_t;
+
+//Where a stream of events goes: the events window it is compiled into and the dmac sending it.
+typedef struct {
+    void* window;
+    uint32_t window_address;    //physical, as seen by the dmac
+    uint32_t window_bytes;
+    void* dmac;
+    event_cache_t* cache;       //NULL to always compile into the window
+} event_target_t;
+
+//What a run of the event streams did, to spot sequences faster than the events can be fed.
+typedef struct {
+    uint32_t nb_events;         //sent to the FPGA
+    bool completed;             //the whole sequence was sent
+    long long elapsed_us;       //compiling and sending
+    long long compile_us;       //compiling or patching, summed over the compile threads
+    long long dma_stall_us;     //time a dmac waited for the next slot, the longest of the streams
+    uint64_t dma_bytes;         //sent by all the dmacs
+    long long abort_us;         //from the abort request to the dmacs being reset, 0 if not aborted
+    uint32_t duty_exceeded;     //mask of the TX over config_rf_duty_limit(), the run was not sent
+    double duty;                //highest TX duty cycle in %, when the sequence was analyzed
+} events_report_t;
+
+//Sets up a cache on an item of an area of the DDR layout on first use.
+//Returns NULL when caching is disabled by config_event_cache() or the area isn't mapped.
+event_cache_t* event_cache_view(event_cache_t* cache, ddr_area_id_t area, uint32_t item);
+
+//Cache of the events of a stream compiled from a bank of the sequence RAMs, see sequence_rams.h.
+//NULL as for event_cache_view().
+event_cache_t* event_cache_bank(event_stream_t stream, uint32_t bank);
+
+//Compiles the sequence staged in bank into its caches without sending anything, so the first run
+//after sequence_rams_swap() only has to send it again. Stops early once *cancel is set.
+//Returns false if it was not compiled: cancelled, or too big for the caches.
+bool precompile_staged_events(uint32_t bank, const volatile bool* cancel);
+
+//Points the target at an events window of the DDR layout, false if it isn't mapped.
+bool event_target_window(event_target_t* target, ddr_area_id_t window);
+
+//RF events window and dmac of the active bank, false if they aren't mapped.
+bool event_target_rf(event_target_t* target);
+
 uint32_t create_events(void);
+
+//Analytics of the sequence of the compiler, see event_compiler_analyze(), kept for the last sequences
+//analyzed. Fills report->duty and report->duty_exceeded, returns false if the sequence is over the duty limit.
+//Always true without analytics, unless config_sequence_analytics() or config_rf_duty_limit() are set.
+bool events_within_limits(const event_compiler_t* compiler, events_report_t* report);
+
+//Compiles the sequence once for both the RF and the gradient streams.
+//Nothing is sent for a sequence which is not within the limits.
+uint32_t create_events_dual(events_report_t* report);
+
+//Events compiled by the host, uploaded in order in chunks at offset bytes into the cache of the active bank
+//of a stream, offset 0 starting the stream again. Until events_upload_clear(), the runs send them instead
+//of compiling the sequence RAMs: the RF events, and the gradient ones if there are as many.
+//Returns false, writing nothing, for a chunk which is not whole events, out of order or past the cache.
+bool events_upload(event_stream_t stream, uint32_t offset, const void* data, uint32_t nbytes);
+void events_upload_clear(void);
+bool events_uploaded(void);
+
+//Sends the uploaded events like create_events_dual().
+uint32_t send_uploaded_events(events_report_t* report);
+
+void log_events_report(const char* name, const events_report_t* report);
+
+//Stops the streams being sent from another thread, and the ones opened until events_abort_clear().
+void events_abort(void);
+void events_abort_clear(void);
+
+//Readiness of a run: events_ready_reset() before the run starts, it is then ready once prefill events
+//of each stream were transferred to the FPGA fifos (or right away for 0), or when it ends having sent
+//all its events, which events_ready_end() tells.
+void events_ready_reset(uint32_t prefill);
+void events_ready_end(bool completed);
+
+//Waits for the run to be ready, timeout_ms 0 to wait forever. The timeout starts once the run opened its
+//streams, after the sequence was analyzed (see events_within_limits()), however long that takes.
+//Returns false on timeout, or if the run ended before its prefill was sent.
+bool events_wait_ready(int timeout_ms);
+
+//Compiles all the events of the compiler into a ring of slot_bytes slots in the target window,
+//each filled slot being sent by a dma engine on the target dmac while the next ones are compiled.
+//The number of slots is set by config_event_ring_slots(). With config_compile_threads() above 1,
+//several slots are compiled at once by a compile pool, and still sent in scan order.
+//When the whole sequence fits in the target cache, it is compiled there instead and the dmac reads it
+//from the cache, so the next runs of the same sequence only have to send it again.
+//Returns the number of events sent, report gets the details.
+uint32_t stream_events_to_fpga(event_compiler_t* compiler, const event_target_t* target, uint32_t slot_bytes, events_report_t* report);
+
+//Same as stream_events_to_fpga() for both streams at once, with events_per_slot events in each slot
+//of the two rings, every chunk being compiled in a single pass over the rows.
+uint32_t stream_dual_events_to_fpga(event_compiler_t* compiler, const event_target_t* rf, const event_target_t* grad, uint32_t events_per_slot,
+    events_report_t* report);
+
 uint32_t printjer(void);
 
 #endif
\ No newline at end of file
@@ -8,11 +8,16 @@
 #include <fcntl.h>    //open()
 #include <sys/mman.h> //mmap()
 
+#include "hps_sequence.h"
+
 #define HPS_RESERVED_ADDRESS    1073741824 
 #define HPS_RESERVED_SPAN       (524288000)     //500Megabytes
 
 #define STEP_32b_RAM            131072
 
+//Gradient events window and dmac of the active bank, false if they aren't mapped.
+bool event_target_grad(event_target_t* target);
+
 uint32_t create_events_grad(void);
 
 #endif
\ No newline at end of file
@@ -1,10 +1,31 @@
 #include "interrupt_reader.h"
 #include "log.h"
+#include "../common/interrupt_device.h"
+
+//records read at once, as many as the interrupt queue of the module holds
+#define MAX_RECORDS 64
 
 static int interrupts_fd;
+static bool record_mode = false;
 static pthread_t thread;
 static interrupt_handler_f handler = NULL;
 
+//asks the module for records when it has them, otherwise interrupts are read one byte at a time
+static bool open_interrupts() {
+	interrupts_fd = open(INTERRUPTS_FILE, O_RDONLY);
+	if (interrupts_fd < 0) {
+		log_error_errno("Unable to open %s", INTERRUPTS_FILE);
+		return false;
+	}
+
+	uint32_t enabled = 1;
+	record_mode = ioctl(interrupts_fd, INTERRUPTS_IOCTL_RECORDS, &enabled) == 0;
+	if (!record_mode) {
+		log_warning_errno("Unable to read %s as records, interrupts will be read one at a time", INTERRUPTS_FILE);
+	}
+	return true;
+}
+
 static bool interrupt_reader_reset() {
 	log_info("Resetting interupt reader, reopening %s file", INTERRUPTS_FILE);
 
@@ -13,50 +34,67 @@ static bool interrupt_reader_reset() {
 		return false;
 	}
 
-	interrupts_fd = open(INTERRUPTS_FILE, O_RDONLY);
-	if (interrupts_fd < 0) {
-		log_error_errno("Unable to open %s", INTERRUPTS_FILE);
-		return false;
+	return open_interrupts();
+}
+
+//number of records read, time_ns is 0 when read one byte at a time
+static int read_interrupts(interrupt_record_t* records) {
+	if (record_mode) {
+		ssize_t nread = read(interrupts_fd, records, MAX_RECORDS * sizeof(interrupt_record_t));
+		return nread < 0 ? -1 : (int)(nread / sizeof(interrupt_record_t));
 	}
 
-	return true;
+	uint8_t code;
+	ssize_t nread = read(interrupts_fd, &code, 1);
+	records[0] = (interrupt_record_t) { .time_ns = 0, .code = code };
+	return (int)nread;
 }
 
 static void* interrupt_reader_thread(void* arg) {
 	log_info("Starting reading interrupts");
 
-	uint8_t code;
-	ssize_t nread;
+	interrupt_record_t records[MAX_RECORDS];
+	int nrecords;
 	struct timespec tstart = { 0, 0 }, tend = { 0, 0 }, tprev = { 0, 0 };
-	while ( (nread = read(interrupts_fd, &code, 1)) >= 0) {
-		if (nread == 0) {
-			//no interrupt, ask again immediately, kernel will wait if needed
-			continue;
-		}
-
-		tprev.tv_sec = tstart.tv_sec;
-		tprev.tv_nsec = tstart.tv_nsec;
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
-		if (tend.tv_sec != 0 || tend.tv_nsec != 0) {
-			log_debug("Time elapsed since last interrupt handler: from start=%.3f ms, from finish=%.3f ms", 
-				(tstart.tv_sec - tprev.tv_sec) * 1000 + (tstart.tv_nsec - tprev.tv_nsec) / 1000000.0f,
-				(tstart.tv_sec - tend.tv_sec) * 1000 + (tstart.tv_nsec - tend.tv_nsec) / 1000000.0f);
+	while ( (nrecords = read_interrupts(records)) >= 0) {
+		//no interrupt when 0, ask again immediately, kernel will wait if needed
+		for (int i = 0; i < nrecords; i++) {
+			uint8_t code = records[i].code;
+			tprev.tv_sec = tstart.tv_sec;
+			tprev.tv_nsec = tstart.tv_nsec;
+			clock_gettime(CLOCK_MONOTONIC, &tstart);
+			if (tend.tv_sec != 0 || tend.tv_nsec != 0) {
+				log_debug("Time elapsed since last interrupt handler: from start=%.3f ms, from finish=%.3f ms", 
+					(tstart.tv_sec - tprev.tv_sec) * 1000 + (tstart.tv_nsec - tprev.tv_nsec) / 1000000.0f,
+					(tstart.tv_sec - tend.tv_sec) * 1000 + (tstart.tv_nsec - tend.tv_nsec) / 1000000.0f);
+			}
+
+			if (records[i].time_ns != 0) {
+				long long latency_ns = tstart.tv_sec * 1000000000LL + tstart.tv_nsec - (long long)records[i].time_ns;
+				log_debug("Read interrupt: 0x%x, %d/%d of the read, queued %.3f ms ago", code, i + 1, nrecords, latency_ns / 1000000.0);
+			}
+			else {
+				log_debug("Read interrupt: 0x%x", code);
+			}
+
+			if (handler == NULL) {
+				log_error("No interrupt handler defined! Ignoring interrupts.");
+				continue;
+			}
+
+			if (!handler(code)) {
+				if (!interrupt_reader_reset()) {
+					log_error("Unrecoverable interrupt error");
+					pthread_exit(0);
+				}
+				//the queue was emptied by reopening, the rest of the records are stale
+				break;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &tend);
+			log_debug("Interrupt handling for 0x%x took %.3f ms", code, 
+				(tend.tv_sec - tstart.tv_sec) * 1000 + (tend.tv_nsec - tstart.tv_nsec) / 1000000.0f);
 		}
-		
-		log_debug("Read interrupt: 0x%x", code);
-		if (handler == NULL) {
-			log_error("No interrupt handler defined! Ignoring interrupts.");
-			continue;
-		}
-
-		if (!handler(code) && !interrupt_reader_reset()) {
-			log_error("Unrecoverable interrupt error");
-			break;
-		}
-
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		log_debug("Interrupt handling for 0x%x took %.3f ms", code, 
-			(tend.tv_sec - tstart.tv_sec) * 1000 + (tend.tv_nsec - tstart.tv_nsec) / 1000000.0f);
 	}
 
 	log_error("Stopped reading interrupts, read failed");
@@ -68,9 +106,7 @@ bool interrupt_reader_start(interrupt_handler_f  interrupt_handler) {
 
 	//open device file for interrupts
 	log_info("Opening %s file", INTERRUPTS_FILE);
-	interrupts_fd = open(INTERRUPTS_FILE, O_RDONLY);
-	if (interrupts_fd < 0) {
-		log_error_errno("Unable to open %s", INTERRUPTS_FILE);
+	if (!open_interrupts()) {
 		return false;
 	}
 
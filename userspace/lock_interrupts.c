@@ -1,6 +1,8 @@
 #include "lock_interrupts.h"
 #include "log.h"
+#include "common.h"
 #include "../common/interrupt_codes.h"
+#include "../common/data_device.h"
 #include "interrupt_handlers.h"
 #include "interrupt_reader.h"
 #include "net_io.h"
@@ -10,9 +12,13 @@
 #include "clientgroup.h"
 
 #define LOCKDATA_FILE "/dev/lockdata"
+//lock memory of the kernel module when its lockdata_bytes parameter can't be read
+#define DEFAULT_LOCKDATA_BYTES 4194304
 
 static bool initialized = false;
 static int data_fd;
+static uint32_t data_bytes = DEFAULT_LOCKDATA_BYTES;
+static const uint8_t* data_map = NULL;	//the lock memory, NULL if the module can't map it
 static pthread_mutex_t client_mutex;
 static clientsocket_t* client = NULL;
 
@@ -41,7 +47,32 @@ static bool send_async(message_t* message) {
 	return workqueue_submit(send_worker, message, cleanup_message);
 }
 
-static bool send_lock_data(off_t offset, size_t nbytes, int isFull) {
+//syncs a range of the mapping, see data_device.h
+static bool sync_data(unsigned long request, off_t offset, size_t nbytes) {
+	data_range_t range = { .offset = offset, .nbytes = nbytes };
+	if (ioctl(data_fd, request, &range) < 0) {
+		log_error_errno("Unable to sync %u bytes at %u of %s", range.nbytes, range.offset, LOCKDATA_FILE);
+		return false;
+	}
+	return true;
+}
+
+//the buffer is freed with the message
+static bool send_lock_buffer(int64_t* buffer, size_t nbytes, int isFull) {
+	message_t* message = create_message_with_body(MSG_LOCK_SCAN_DONE, buffer, nbytes);
+	if (message == NULL) {
+		free(buffer);
+		return false;
+	}
+
+	message->header.param1 = isFull;
+	message->header.param2 = 0; //address?
+	message->header.param6 = 0; //last transfert time
+	return send_async(message);
+}
+
+//reads the half through the module, which syncs it by itself
+static bool read_lock_data(off_t offset, size_t nbytes, int isFull) {
 	int64_t* buffer = malloc(nbytes);
 	if (buffer == NULL) {
 		log_error_errno("Unable to malloc buffer of %d bytes", nbytes);
@@ -62,16 +93,54 @@ static bool send_lock_data(off_t offset, size_t nbytes, int isFull) {
 	//log_info("read lock data (%d bytes): %.3f ms", nbytes,
 	//	(tend.tv_sec - tstart.tv_sec) * 1000 + (tend.tv_nsec - tstart.tv_nsec) / 1000000.0f);
 	
-	message_t* message = create_message_with_body(MSG_LOCK_SCAN_DONE, buffer, nbytes);
-	if (message == NULL) {
-		free(buffer);
+	return send_lock_buffer(buffer, nbytes, isFull);
+}
+
+typedef struct {
+	off_t offset;
+	size_t nbytes;
+	int isFull;
+} mapped_half_t;
+
+//runs in the work queue, after the messages queued before the half
+static void send_mapped_worker(void* data) {
+	const mapped_half_t* half = (const mapped_half_t*)data;
+	header_t header;
+	reset_header(&header);
+	header.cmd = MSG_LOCK_SCAN_DONE;
+	header.param1 = half->isFull;
+	header.body_size = half->nbytes;
+
+	pthread_mutex_lock(&client_mutex);
+	if (client != NULL) {
+		send_message(client, &header, data_map + half->offset);
+	}
+	pthread_mutex_unlock(&client_mutex);
+}
+
+//sends the half straight from the mapping, without a copy: the handler waits for the send,
+//as the FPGA may write the half again as soon as it returns
+static bool send_mapped_lock_data(off_t offset, size_t nbytes, int isFull) {
+	if (offset + nbytes > data_bytes) {
+		log_error("Lock data of %d bytes at %d is past the end of %s", nbytes, offset, LOCKDATA_FILE);
 		return false;
 	}
 
-	message->header.param1 = isFull; 
-	message->header.param2 = 0; //address?
-	message->header.param6 = 0; //last transfert time
-	return send_async(message);
+	if (!sync_data(DATA_IOCTL_SYNC_FOR_CPU, offset, nbytes)) {
+		return read_lock_data(offset, nbytes, isFull);
+	}
+
+	mapped_half_t half = { .offset = offset, .nbytes = nbytes, .isFull = isFull };
+	bool sent = workqueue_run(send_mapped_worker, &half);
+	sync_data(DATA_IOCTL_SYNC_FOR_DEVICE, offset, nbytes);
+	return sent;
+}
+
+static bool send_lock_data(off_t offset, size_t nbytes, int isFull) {
+	if (data_map != NULL) {
+		return send_mapped_lock_data(offset, nbytes, isFull);
+	}
+	return read_lock_data(offset, nbytes, isFull);
 }
 
 //-- lock interrupt function
@@ -104,6 +173,19 @@ bool lock_interrupts_init() {
 		return false;
 	}
 
+	if (!read_module_param("lockdata_bytes", &data_bytes)) {
+		data_bytes = DEFAULT_LOCKDATA_BYTES;
+		log_warning("Unable to read the lockdata_bytes module parameter, %s is assumed to be %u bytes", LOCKDATA_FILE, data_bytes);
+	}
+
+	void* map = mmap(NULL, data_bytes, PROT_READ, MAP_SHARED, data_fd, 0);
+	if (map == MAP_FAILED) {
+		log_warning_errno("Unable to mmap %s, the lock data will be read", LOCKDATA_FILE);
+	}
+	else {
+		data_map = map;
+	}
+
 	initialized = true;
 	return true;
 }
@@ -116,6 +198,11 @@ bool lock_interrupts_destroy() {
 
 	lock_interrupts_set_client(NULL);
 
+	if (data_map != NULL && munmap((void*)data_map, data_bytes) < 0) {
+		log_error_errno("Unable to munmap data file");
+	}
+	data_map = NULL;
+
 	if (close(data_fd) < 0) {
 		log_error_errno("Unable to close data file");
 		return false;
@@ -15,6 +15,7 @@ int shim_config_main(int argc, char** argv);
 int amps_main(int argc, char** argv);
 int pa_main(int argc, char** argv);
 int lock_main(int argc, char** argv);
+int compile_main(int argc, char** argv);
 
 int main(int argc, char** argv) {
 	if (!log_init(config_log_level(), config_log_file())) {
@@ -32,6 +33,8 @@ int main(int argc, char** argv) {
 		return pa_main(argc - 1, argv + 1);
 	}else if (argc > 1 && strcmp(argv[1], "lock") == 0) {
 		return lock_main(argc - 1, argv + 1);
+	}else if (argc > 1 && strcmp(argv[1], "compile") == 0) {
+		return compile_main(argc - 1, argv + 1);
 	}
 	else {
 		return cameleon_main(argc, argv);
@@ -50,6 +50,9 @@ Memory map, copied as-is from CameleonNIOS
 #define RAM_CURRENT_ZERO_OFFSETS					179
 #define RAM_SHIM_DAC_WORDS							180
 #define RAM_DDR_GRAD								10000
+#define RAM_DDR_RF_EVENTS							10001		//RF events compiled by the host, see events_upload()
+#define RAM_DDR_GRAD_EVENTS							10002
+#define RAM_DDR_LOOP_PROGRAM						10003		//loop program of the sequence, see event_program.h
 #define RAM_LUT_0								    20000
 #define RAM_LUT_1								    20001
 #define RAM_LUT_2								    20002
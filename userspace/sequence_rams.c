@@ -0,0 +1,318 @@
+#include "sequence_rams.h"
+#include "log.h"
+#include "common.h"
+
+#define SEQUENCE_RAM_BYTES (SEQUENCE_RAM_WORDS * 4)
+
+static bool initialized = false;
+static pthread_mutex_t mutex;
+static uint8_t* reserved;
+static uint32_t* copies[SEQUENCE_RAM_BANKS][SEQUENCE_RAM_SLOTS];
+static uint64_t generation;
+static uint64_t generations[SEQUENCE_RAM_BANKS][SEQUENCE_RAM_SLOTS];
+
+//the other bank is the staged one
+static uint32_t active = 0;
+static bool staging = false;
+static bool staged = false;
+//what was written in the staged bank, to be copied to the reserved ddr and the hardware on swap
+static uint32_t staged_bytes[SEQUENCE_RAM_SLOTS];
+static uint32_t staged_registers[SEQUENCE_RAM_WORDS / 32];
+
+//--
+
+bool sequence_rams_init(void* reserved_base) {
+	log_debug("Creating sequence rams mutex");
+	if (pthread_mutex_init(&mutex, NULL) != 0) {
+		log_error("Unable to init mutex");
+		return false;
+	}
+
+	reserved = reserved_base;
+	memset(copies, 0, sizeof(copies));
+	active = 0;
+	staging = false;
+	staged = false;
+
+	//whatever is already in the reserved ddr is the first generation
+	generation = 1;
+	for (int i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		generations[active][i] = generation;
+	}
+	initialized = true;
+	return true;
+}
+
+//must be called with the mutex held.
+static void free_bank(uint32_t bank) {
+	for (int i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		free(copies[bank][i]);
+		copies[bank][i] = NULL;
+	}
+}
+
+void sequence_rams_destroy() {
+	if (!initialized) {
+		return;
+	}
+
+	initialized = false;
+	for (uint32_t bank = 0; bank < SEQUENCE_RAM_BANKS; bank++) {
+		free_bank(bank);
+	}
+	pthread_mutex_destroy(&mutex);
+}
+
+//must be called with the mutex held.
+static void mark_changed(uint32_t bank, uint32_t ram_id) {
+	generations[bank][ram_id] = ++generation;
+}
+
+//allocates the copy of a ram of the active bank, the bytes after "skip" are copied from the reserved ddr.
+//must be called with the mutex held.
+static uint32_t* load_copy(uint32_t ram_id, uint32_t skip) {
+	if (copies[active][ram_id] != NULL) {
+		return copies[active][ram_id];
+	}
+
+	uint32_t* copy = malloc(SEQUENCE_RAM_BYTES);
+	if (copy == NULL) {
+		log_error("Unable to allocate copy of sequence ram %u", ram_id);
+		return NULL;
+	}
+
+	if (skip < SEQUENCE_RAM_BYTES) {
+		memcpy((uint8_t*)copy + skip, reserved + ram_id * RAM_OFFSET_STEP + skip, SEQUENCE_RAM_BYTES - skip);
+	}
+	copies[active][ram_id] = copy;
+	return copy;
+}
+
+//allocates the copy of a ram of the staged bank, starting as the active one.
+//must be called with the mutex held.
+static uint32_t* load_staged_copy(uint32_t ram_id) {
+	uint32_t bank = 1 - active;
+	if (copies[bank][ram_id] != NULL) {
+		return copies[bank][ram_id];
+	}
+
+	uint32_t* source = load_copy(ram_id, 0);
+	if (source == NULL) {
+		return NULL;
+	}
+
+	uint32_t* copy = malloc(SEQUENCE_RAM_BYTES);
+	if (copy == NULL) {
+		log_error("Unable to allocate staged copy of sequence ram %u", ram_id);
+		return NULL;
+	}
+	memcpy(copy, source, SEQUENCE_RAM_BYTES);
+	copies[bank][ram_id] = copy;
+	return copy;
+}
+
+bool sequence_rams_write(uint32_t ram_id, const void* data, uint32_t nbytes) {
+	if (ram_id >= SEQUENCE_RAM_SLOTS || nbytes > SEQUENCE_RAM_BYTES) {
+		log_error("Invalid write of %u bytes to sequence ram %u", nbytes, ram_id);
+		return false;
+	}
+
+	pthread_mutex_lock(&mutex);
+	if (staging) {
+		uint32_t* copy = load_staged_copy(ram_id);
+		if (copy != NULL) {
+			if (memcmp(copy, data, nbytes) != 0) {
+				memcpy(copy, data, nbytes);
+				mark_changed(1 - active, ram_id);
+			}
+			staged_bytes[ram_id] = MAXIMUM(staged_bytes[ram_id], nbytes);
+		}
+		pthread_mutex_unlock(&mutex);
+		return copy != NULL;
+	}
+
+	bool loaded = copies[active][ram_id] != NULL;
+	uint32_t* copy = load_copy(ram_id, nbytes);
+	if (copy != NULL && (!loaded || memcmp(copy, data, nbytes) != 0)) {
+		memcpy(copy, data, nbytes);
+		mark_changed(active, ram_id);
+	}
+	pthread_mutex_unlock(&mutex);
+
+	memcpy(reserved + ram_id * RAM_OFFSET_STEP, data, nbytes);
+	return copy != NULL;
+}
+
+bool sequence_rams_write_register(uint32_t index, uint32_t value, bool* deferred) {
+	*deferred = false;
+	if (index >= SEQUENCE_RAM_WORDS) {
+		log_error("Invalid sequence register %u", index);
+		return false;
+	}
+
+	pthread_mutex_lock(&mutex);
+	uint32_t bank = staging ? 1 - active : active;
+	uint32_t* copy = staging ? load_staged_copy(RAM_REGISTERS_INDEX) : load_copy(RAM_REGISTERS_INDEX, 0);
+	if (copy != NULL && copy[index] != value) {
+		copy[index] = value;
+		//most registers are acquisition settings, they do not change the events
+		if (event_compiler_reads_register(index)) {
+			mark_changed(bank, RAM_REGISTERS_INDEX);
+		}
+	}
+	if (copy != NULL && staging) {
+		staged_registers[index / 32] |= 1u << (index % 32);
+		*deferred = true;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	if (!*deferred) {
+		((uint32_t*)(reserved + RAM_REGISTERS_INDEX * RAM_OFFSET_STEP))[index] = value;
+	}
+	return copy != NULL;
+}
+
+uint64_t sequence_rams_generation(uint32_t ram_id) {
+	if (ram_id >= SEQUENCE_RAM_SLOTS) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&mutex);
+	uint64_t value = generations[active][ram_id];
+	pthread_mutex_unlock(&mutex);
+	return value;
+}
+
+//rams without a copy in bank are read from the active one.
+//must be called with the mutex held.
+static bool bank_source(uint32_t bank, sequence_source_t* source) {
+	//rams not read by the compiler are left on the reserved ddr, they are never dereferenced
+	sequence_source_from_reserved(source, reserved);
+	source->structure_generation = 0;
+
+	for (uint32_t i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		if (i == RAM_REGISTERS_INDEX || event_compiler_reads_ram(i)) {
+			uint32_t* copy = copies[bank][i] != NULL ? copies[bank][i] : load_copy(i, 0);
+			if (copy == NULL) {
+				return false;
+			}
+			source->rams[i] = copy;
+			source->generation = MAXIMUM(source->generation, generations[bank][i]);
+			if (!event_compiler_is_element_ram(i)) {
+				source->structure_generation = MAXIMUM(source->structure_generation, generations[bank][i]);
+			}
+		}
+	}
+	source->registers = source->rams[RAM_REGISTERS_INDEX];
+	return true;
+}
+
+bool sequence_rams_source(sequence_source_t* source) {
+	pthread_mutex_lock(&mutex);
+	bool success = bank_source(active, source);
+	pthread_mutex_unlock(&mutex);
+
+	return success;
+}
+
+uint32_t sequence_rams_active_bank() {
+	pthread_mutex_lock(&mutex);
+	uint32_t bank = active;
+	pthread_mutex_unlock(&mutex);
+	return bank;
+}
+
+void sequence_rams_stage_begin() {
+	pthread_mutex_lock(&mutex);
+	uint32_t bank = 1 - active;
+	free_bank(bank);
+	for (int i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		generations[bank][i] = generations[active][i];
+	}
+	memset(staged_bytes, 0, sizeof(staged_bytes));
+	memset(staged_registers, 0, sizeof(staged_registers));
+	staging = true;
+	staged = true;
+	pthread_mutex_unlock(&mutex);
+
+	log_info("Staging the next sequence in bank %u", bank);
+}
+
+bool sequence_rams_stage_end(uint32_t* bank) {
+	pthread_mutex_lock(&mutex);
+	bool was_staging = staging;
+	staging = false;
+	*bank = 1 - active;
+	pthread_mutex_unlock(&mutex);
+	return was_staging;
+}
+
+bool sequence_rams_staged_source(sequence_source_t* source) {
+	pthread_mutex_lock(&mutex);
+	bool success = staged && !staging && bank_source(1 - active, source);
+	pthread_mutex_unlock(&mutex);
+
+	return success;
+}
+
+bool sequence_rams_swap(void (*write_register)(uint32_t index, uint32_t value)) {
+	pthread_mutex_lock(&mutex);
+	if (!staged) {
+		pthread_mutex_unlock(&mutex);
+		log_error("No sequence staged to swap in");
+		return false;
+	}
+
+	//the registers are written to the hardware once swapped, write_register goes through the active bank.
+	//Allocated first, so that the banks are left as they are when it fails
+	uint32_t nb_registers = 0;
+	for (uint32_t i = 0; i < SEQUENCE_RAM_WORDS / 32; i++) {
+		nb_registers += __builtin_popcount(staged_registers[i]);
+	}
+	uint32_t* written = malloc(2 * nb_registers * sizeof(uint32_t));
+	if (nb_registers > 0 && written == NULL) {
+		pthread_mutex_unlock(&mutex);
+		log_error("Unable to allocate the %u staged registers, the staged sequence is not swapped in", nb_registers);
+		return false;
+	}
+
+	long long start = monotonic_us();
+	uint32_t bank = 1 - active;
+	uint32_t nb_bytes = 0;
+	for (uint32_t i = 0; i < SEQUENCE_RAM_SLOTS; i++) {
+		if (copies[bank][i] == NULL) {
+			//not staged, the active copy carries over with its generation
+			copies[bank][i] = copies[active][i];
+			copies[active][i] = NULL;
+			generations[bank][i] = generations[active][i];
+		}
+		else if (staged_bytes[i] > 0) {
+			memcpy(reserved + i * RAM_OFFSET_STEP, copies[bank][i], staged_bytes[i]);
+			nb_bytes += staged_bytes[i];
+		}
+	}
+
+	uint32_t* registers = copies[bank][RAM_REGISTERS_INDEX];
+	for (uint32_t i = 0, n = 0; n < nb_registers; i++) {
+		if (staged_registers[i / 32] & (1u << (i % 32))) {
+			written[2 * n] = i;
+			written[2 * n + 1] = registers[i];
+			n++;
+		}
+	}
+
+	free_bank(active);
+	active = bank;
+	staging = false;
+	staged = false;
+	pthread_mutex_unlock(&mutex);
+
+	for (uint32_t i = 0; i < nb_registers; i++) {
+		write_register(written[2 * i], written[2 * i + 1]);
+	}
+	free(written);
+
+	log_info("Swapped to sequence bank %u: %u bytes of rams and %u registers written in %lld us",
+		bank, nb_bytes, nb_registers, monotonic_us() - start);
+	return true;
+}
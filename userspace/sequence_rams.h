@@ -0,0 +1,70 @@
+#ifndef _SEQUENCE_RAMS_H_
+#define _SEQUENCE_RAMS_H_
+
+/*
+Cached copies of the sequence RAMs and registers read by the event compiler.
+
+cmd_write stores the sequence RAMs in the reserved DDR, which is only reachable through
+the uncached /dev/mem mapping: reading it from the event loop costs a bus access per word.
+Every write is also done here, in normal cacheable memory, and the compiler reads these copies.
+A RAM which has not been written since startup is copied once from the reserved DDR
+the first time it is needed.
+
+Only the CPU writes these RAMs, so the copies never need to be invalidated.
+
+Each RAM also keeps the generation of its last change. Writing the same content again,
+as happens when a sequence is sent again before each run, does not change it, so compiled
+events can be reused as long as the generations of the RAMs they come from stay the same.
+
+The copies come in two banks. While the active bank is read by the runs, the next sequence can
+be staged in the other one: between sequence_rams_stage_begin() and sequence_rams_stage_end() the
+writes only go to the staged bank, the reserved DDR and the hardware registers being left to the
+running sequence. sequence_rams_swap() then makes it the active bank in one go. A staged RAM starts
+as its active copy, so only the RAMs which change need to be written again.
+*/
+
+#include "std_includes.h"
+#include "event_compiler.h"
+
+#define SEQUENCE_RAM_BANKS 2
+
+bool sequence_rams_init(void* reserved_base);
+void sequence_rams_destroy();
+
+//Writes the first nbytes of a sequence RAM, in the reserved DDR and in its cached copy,
+//or only in the copy of the staged bank while staging.
+bool sequence_rams_write(uint32_t ram_id, const void* data, uint32_t nbytes);
+
+//Writes one word of the sequence registers RAM.
+//While staging, *deferred is set: the hardware register is to be written by sequence_rams_swap().
+bool sequence_rams_write_register(uint32_t index, uint32_t value, bool* deferred);
+
+//Generation of the last change of a RAM, comparable with sequence_source_t.generation.
+uint64_t sequence_rams_generation(uint32_t ram_id);
+
+//Points the compiler source at the cached copies.
+//Its generation is the last change of a RAM or register read by the compiler,
+//its structure generation the last change of those which are not element RAMs.
+bool sequence_rams_source(sequence_source_t* source);
+
+//Bank read by sequence_rams_source().
+uint32_t sequence_rams_active_bank();
+
+//Starts staging the next sequence in the other bank, dropping what was staged there before.
+void sequence_rams_stage_begin();
+
+//Stops staging, the next writes go to the active bank again. The staged bank is kept for sequence_rams_swap().
+//Returns the staged bank, false if none was being staged.
+bool sequence_rams_stage_end(uint32_t* bank);
+
+//Points the compiler source at the copies of the staged bank, to compile its events ahead of the swap.
+//It must not be staging anymore, and the source is valid until the next sequence_rams_stage_begin() or swap.
+bool sequence_rams_staged_source(sequence_source_t* source);
+
+//Makes the staged bank the active one: its RAMs are copied to the reserved DDR, then the registers written
+//while staging are passed to write_register, to be written again now that they are active. False if no sequence was staged,
+//or if its registers could not be held for writing, the active bank being left as it was.
+//No run may be reading the active bank.
+bool sequence_rams_swap(void (*write_register)(uint32_t index, uint32_t value));
+
+#endif
@@ -1,6 +1,8 @@
 #include "sequencer_interrupts.h"
 #include "log.h"
+#include "common.h"
 #include "../common/interrupt_codes.h"
+#include "../common/data_device.h"
 #include "interrupt_handlers.h"
 #include "interrupt_reader.h"
 #include "net_io.h"
@@ -12,9 +14,14 @@
 #include "hardware.h"
 
 #define RXDATA_FILE "/dev/rxdata"
+//acquisition memory of the kernel module when its rxdata_bytes parameter can't be read
+#define DEFAULT_RXDATA_BYTES 4194304
 
 static bool initialized = false;
 static int data_fd;
+static uint32_t data_bytes = DEFAULT_RXDATA_BYTES;
+static const uint8_t* data_map = NULL;	//the acquisition memory, NULL if the module can't map it
+static volatile uint32_t snapshot_depth = 0;	//of the snapshot ring of the module, 0 when the halves are copied when their interrupt is handled
 static pthread_mutex_t client_mutex;
 static clientsocket_t* client = NULL;
 
@@ -41,6 +48,20 @@ static bool send_async(message_t* message) {
 	return workqueue_submit(send_worker, message, cleanup_message);
 }
 
+bool sequencer_interrupts_send(message_t* message) {
+	return send_async(message);
+}
+
+//syncs a range of the mapping, see data_device.h
+static bool sync_data(unsigned long request, off_t offset, size_t nbytes) {
+	data_range_t range = { .offset = offset, .nbytes = nbytes };
+	if (ioctl(data_fd, request, &range) < 0) {
+		log_error_errno("Unable to sync %u bytes at %u of %s", range.nbytes, range.offset, RXDATA_FILE);
+		return false;
+	}
+	return true;
+}
+
 //-- interrupt handlers
 
 static bool failure(uint8_t code) {
@@ -82,8 +103,22 @@ static bool scan_done(uint8_t code) {
 	return send_async(message);
 }
 
+static void log_snapshot_status() {
+	data_snapshot_status_t status;
+	if (snapshot_depth == 0) {
+		return;
+	}
+	if (ioctl(data_fd, DATA_IOCTL_SNAPSHOT_STATUS, &status) < 0) {
+		log_error_errno("Unable to get the snapshot ring status");
+		return;
+	}
+	log_info("Snapshot ring: %u halves taken, high-water %u / %u, %u lost, %u queued", status.taken, status.high_water, status.depth,
+		status.overruns, status.queued);
+}
+
 static bool sequence_done(uint8_t code) {
 	log_info("Received sequence_done interrupt, code=0x%x", code);
+	log_snapshot_status();
 	stop_sequence();
 
 	sequence_params_t* sp = sequence_params_acquire();
@@ -107,7 +142,22 @@ static bool sequence_done(uint8_t code) {
 
 //--
 
-static bool send_acq_data(off_t offset, size_t nbytes) {
+//the buffer is freed with the message
+static bool send_acq_buffer(int32_t* buffer, size_t nbytes) {
+	message_t* message = create_message_with_body(MSG_ACQU_TRANSFER, buffer, nbytes);
+	if (message == NULL) {
+		free(buffer);
+		return false;
+	}
+
+	message->header.param1 = 0; //address?
+	message->header.param2 = 0; //address?
+	message->header.param6 = 0; //last transfert time
+	return send_async(message);
+}
+
+//reads the half through the module, which syncs it by itself
+static bool read_acq_data(off_t offset, size_t nbytes) {
 	int32_t* buffer = malloc(nbytes);
 	if (buffer == NULL) {
 		log_error_errno("Unable to malloc buffer of %d bytes", nbytes);
@@ -128,16 +178,84 @@ static bool send_acq_data(off_t offset, size_t nbytes) {
 	log_info("read sequencer data (%d bytes): %.3f ms", nbytes,
 		(tend.tv_sec - tstart.tv_sec) * 1000 + (tend.tv_nsec - tstart.tv_nsec) / 1000000.0f);
 
-	message_t* message = create_message_with_body(MSG_ACQU_TRANSFER, buffer, nbytes);
-	if (message == NULL) {
+	return send_acq_buffer(buffer, nbytes);
+}
+
+typedef struct {
+	off_t offset;
+	size_t nbytes;
+} mapped_half_t;
+
+//runs in the work queue, after the messages queued before the half
+static void send_mapped_worker(void* data) {
+	const mapped_half_t* half = (const mapped_half_t*)data;
+	header_t header;
+	reset_header(&header);
+	header.cmd = MSG_ACQU_TRANSFER;
+	header.body_size = half->nbytes;
+
+	pthread_mutex_lock(&client_mutex);
+	if (client != NULL) {
+		send_message(client, &header, data_map + half->offset);
+	}
+	pthread_mutex_unlock(&client_mutex);
+}
+
+//sends the half straight from the mapping, without a copy: the handler waits for the send,
+//as the FPGA may write the half again as soon as it returns
+static bool send_mapped_acq_data(off_t offset, size_t nbytes) {
+	if (offset + nbytes > data_bytes) {
+		log_error("Acquisition data of %d bytes at %d is past the end of %s", nbytes, offset, RXDATA_FILE);
+		return false;
+	}
+
+	if (!sync_data(DATA_IOCTL_SYNC_FOR_CPU, offset, nbytes)) {
+		return read_acq_data(offset, nbytes);
+	}
+
+	long long start = monotonic_us();
+	mapped_half_t half = { .offset = offset, .nbytes = nbytes };
+	bool sent = workqueue_run(send_mapped_worker, &half);
+	sync_data(DATA_IOCTL_SYNC_FOR_DEVICE, offset, nbytes);
+	log_info("sent sequencer data from the mapping (%d bytes): %.3f ms", nbytes, (monotonic_us() - start) / 1000.0);
+	return sent;
+}
+
+//the module copied the half when its interrupt happened, the oldest snapshot is the one of this interrupt
+static bool send_snapshot_acq_data(off_t offset, size_t nbytes) {
+	int32_t* buffer = malloc(nbytes);
+	if (buffer == NULL) {
+		log_error_errno("Unable to malloc buffer of %d bytes", nbytes);
+		return false;
+	}
+
+	long long start = monotonic_us();
+	data_snapshot_t snapshot = { .buffer = (uintptr_t)buffer, .nbytes = nbytes };
+	if (ioctl(data_fd, DATA_IOCTL_SNAPSHOT_TAKE, &snapshot) < 0) {
+		log_error_errno("Unable to take the snapshot of the sequencer data at %d", offset);
 		free(buffer);
 		return false;
 	}
+	if (snapshot.offset != offset) {
+		//the ring is out of step with the interrupts, false resets both
+		log_error("Snapshot of the sequencer data at %u, expected at %d", snapshot.offset, offset);
+		free(buffer);
+		return false;
+	}
+	log_info("took sequencer data snapshot (%d bytes, %u more queued, %u lost): %.3f ms", nbytes, snapshot.queued, snapshot.overruns,
+		(monotonic_us() - start) / 1000.0);
 
-	message->header.param1 = 0; //address?
-	message->header.param2 = 0; //address?
-	message->header.param6 = 0; //last transfert time
-	return send_async(message);
+	return send_acq_buffer(buffer, nbytes);
+}
+
+static bool send_acq_data(off_t offset, size_t nbytes) {
+	if (snapshot_depth > 0) {
+		return send_snapshot_acq_data(offset, nbytes);
+	}
+	if (data_map != NULL) {
+		return send_mapped_acq_data(offset, nbytes);
+	}
+	return read_acq_data(offset, nbytes);
 }
 
 static bool acquisition_half_full(uint8_t code) {
@@ -162,6 +280,39 @@ static bool acquisition_full(uint8_t code) {
 
 //--
 
+bool sequencer_interrupts_block_fits(uint32_t nbytes) {
+	if ((uint64_t)nbytes * 2 <= data_bytes) {
+		return true;
+	}
+
+	log_error("Acquisition halves of %u bytes do not fit in the %u bytes of %s, load the module with a larger rxdata_bytes", nbytes,
+		data_bytes, RXDATA_FILE);
+	message_t* message = create_message(MSG_BLOCK_TOO_LARGE);
+	if (message != NULL) {
+		message->header.param1 = nbytes;
+		message->header.param2 = data_bytes;
+		send_async(message);
+	}
+	return false;
+}
+
+void sequencer_interrupts_set_block_size(uint32_t nbytes) {
+	if (!initialized) {
+		log_error("Trying to set the acquisition block size, but interrupts are not initalized!");
+		return;
+	}
+
+	int depth = ioctl(data_fd, DATA_IOCTL_SNAPSHOT_SETUP, &nbytes);
+	if (depth < 0) {
+		log_warning_errno("Unable to set up the snapshot ring for blocks of %u bytes, the halves will be copied when handled", nbytes);
+		depth = 0;
+	}
+	else if (depth > 0) {
+		log_info("Snapshot ring of %d blocks of %u bytes", depth, nbytes);
+	}
+	snapshot_depth = depth;
+}
+
 bool sequencer_interrupts_init() {
 	log_debug("Creating interrupts mutex");
 	if (pthread_mutex_init(&client_mutex, NULL) != 0) {
@@ -176,6 +327,19 @@ bool sequencer_interrupts_init() {
 		return false;
 	}
 
+	if (!read_module_param("rxdata_bytes", &data_bytes)) {
+		data_bytes = DEFAULT_RXDATA_BYTES;
+		log_warning("Unable to read the rxdata_bytes module parameter, %s is assumed to be %u bytes", RXDATA_FILE, data_bytes);
+	}
+
+	void* map = mmap(NULL, data_bytes, PROT_READ, MAP_SHARED, data_fd, 0);
+	if (map == MAP_FAILED) {
+		log_warning_errno("Unable to mmap %s, the acquisition data will be read", RXDATA_FILE);
+	}
+	else {
+		data_map = map;
+	}
+
 	initialized = true;
 	return true;
 }
@@ -188,6 +352,11 @@ bool sequencer_interrupts_destroy() {
 
 	sequencer_interrupts_set_client(NULL);
 
+	if (data_map != NULL && munmap((void*)data_map, data_bytes) < 0) {
+		log_error_errno("Unable to munmap data file");
+	}
+	data_map = NULL;
+
 	if (close(data_fd) < 0) {
 		log_error_errno("Unable to close data file");
 		return false;
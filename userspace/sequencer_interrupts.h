@@ -7,6 +7,7 @@ Interrupt handlers: interrupt implementations.
 
 #include "std_includes.h"
 #include "network.h"
+#include "net_io.h"
 
 //notifications from sequencer to software
 #define MSG_SCAN_DONE			0x10000 + 0x0
@@ -19,6 +20,14 @@ Interrupt handlers: interrupt implementations.
 #define MSG_ACQU_CORRUPTED		0x10000 + 0x7
 #define MSG_ACQU_DONE			0x10000 + 0x8
 #define MSG_TIME_TO_UPDATE		0x10000 + 0x9
+//events sent, compile us, dma stall us, kB sent, elapsed us, 0 if complete/us the abort took if aborted
+#define MSG_EVENTS_REPORT		0x10000 + 0xA
+//the sequence was not started, its first events were not in the fifos in time: prefill events, timeout ms
+#define MSG_EVENTS_NOT_READY	0x10000 + 0xB
+//the FIFO interrupt register was not written, its halves do not fit in the acquisition memory: block bytes, memory bytes
+#define MSG_BLOCK_TOO_LARGE		0x10000 + 0xC
+//an events upload chunk was not written, the log tells why: ram id, offset, bytes
+#define MSG_EVENTS_UPLOAD_REJECTED	0x10000 + 0xD
 
 //--
 
@@ -33,6 +42,17 @@ bool sequencer_interrupts_destroy();
 //Can be set to NULL to disable sending before freeing the socket.
 void sequencer_interrupts_set_client(clientsocket_t* clientsocket);
 
+//Sends a message to the sequencer client, from the work queue.
+bool sequencer_interrupts_send(message_t* message);
+
+//Checks that the FPGA can write two halves of nbytes in the acquisition memory,
+//otherwise logs why and sends MSG_BLOCK_TOO_LARGE to the client.
+bool sequencer_interrupts_block_fits(uint32_t nbytes);
+
+//Sets up the snapshot ring of the kernel module for acquisition halves of nbytes, see data_device.h.
+//Without a ring (snapshot_depth=0 module parameter), the handlers copy the halves themselves.
+void sequencer_interrupts_set_block_size(uint32_t nbytes);
+
 //Registers all handlers
 bool register_sequencer_interrupts();
 
@@ -1,16 +1,32 @@
 #include "shared_memory.h"
+#include "ddr_layout.h"
 #include "log.h"
+#include "common.h"
 
 static bool initialized = false;
 static pthread_mutex_t mutex;
 static int fd;
 static shared_memory_t sharedmem;
 
+static region_t regions[NB_OF_REGIONS] = {
+	[REGION_LW_BRIDGE] = { .name = "lightweight bridge", .address = LW_BRIDGE_ADDRESS, .span = LW_BRIDGE_SPAN },
+	[REGION_RESERVED] = { .name = "reserved sequence rams", .address = RESERVED_ADDRESS, .span = RESERVED_SPAN },
+	[REGION_EVENTS] = { .name = "events windows", .address = EVENTS_ADDRESS, .span = EVENTS_SPAN },
+};
+
 //--
 
 static bool shared_memory_munmap_and_close() {
 	log_debug("Cleaning up mmapped memory");
 
+	for (int i = 0; i < NB_OF_REGIONS; i++) {
+		if (regions[i].base != NULL && munmap(regions[i].base, regions[i].span) != 0) {
+			log_error_errno("Unable to munmap %s", regions[i].name);
+			return false;
+		}
+		regions[i].base = NULL;
+	}
+
 	if (sharedmem.lwbridge != MAP_FAILED && munmap(sharedmem.lwbridge, CONTROL_INTERFACE_SPAN) != 0) {
 		log_error_errno("Unable to munmap CONTROL_INTERFACE (hps2fpga lightweight bridge)");
 		return false;
@@ -395,6 +411,51 @@ bool shared_memory_init(const char* memory_file) {
 	return true;
 }
 
+bool shared_memory_map_regions(bool populate) {
+	if (!initialized) {
+		log_error("Trying to map regions, but shared memory isn't initialized!");
+		return false;
+	}
+
+	long long start = monotonic_us();
+	for (int i = 0; i < NB_OF_REGIONS; i++) {
+		region_t* region = &regions[i];
+		if (region->base != NULL) {
+			continue;
+		}
+
+		uint32_t span = ddr_layout_span(i);
+		if (span > 0) {
+			region->span = span;
+		}
+
+		void* base = mmap(NULL, region->span, PROT_READ | PROT_WRITE, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, region->address);
+		if (base == MAP_FAILED) {
+			log_error_errno("Unable to mmap %s (0x%x, %u bytes)", region->name, region->address, region->span);
+			return false;
+		}
+		region->base = base;
+	}
+
+	log_info("Regions mapped in %lld us%s", monotonic_us() - start, populate ? ", populated" : "");
+	return true;
+}
+
+void* shared_memory_view(region_id_t id, uint32_t address, uint32_t span) {
+	region_t* region = &regions[id];
+	if (region->base == NULL) {
+		log_error("Trying to view %s, but it isn't mapped!", region->name);
+		return NULL;
+	}
+
+	if (address < region->address || span > region->span || address - region->address > region->span - span) {
+		log_error("0x%x (%u bytes) is outside of %s", address, span, region->name);
+		return NULL;
+	}
+
+	return (uint8_t*)region->base + (address - region->address);
+}
+
 shared_memory_t* shared_memory_acquire() {
 	if (!initialized) {
 		log_error("Trying to acquire shared memory, but it isn't initialized!");
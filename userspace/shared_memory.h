@@ -19,6 +19,30 @@ Shared memory, allows read/write access to FPGA memory
 #define SEQ_START	0x3
 #define SEQ_REPEAT	0x1
 
+//physical regions mapped once by shared_memory_map_regions()
+#define LW_BRIDGE_ADDRESS		0xff200000
+#define LW_BRIDGE_SPAN			1048576		//whole lightweight bridge, the dmacs are above CONTROL_INTERFACE_SPAN
+#define RESERVED_ADDRESS		1073741824
+#define RESERVED_SPAN			524288000	//500Megabytes of sequence rams and events caches
+#define EVENTS_ADDRESS			1598029824	//rf then gradient events windows, right after the reserved rams
+#define EVENTS_SPAN				8388608		//at most, the windows are sized by ddr_layout_init()
+
+//what is in the reserved and events regions is defined in ddr_layout.h
+
+typedef enum {
+	REGION_LW_BRIDGE,
+	REGION_RESERVED,
+	REGION_EVENTS,
+	NB_OF_REGIONS,
+} region_id_t;
+
+typedef struct {
+	const char* name;
+	uint32_t address;
+	uint32_t span;
+	void* base;
+} region_t;
+
 typedef struct {
 	int32_t* read_ptr;
 	int32_t* write_ptr;
@@ -102,7 +126,16 @@ shared_memory_t* shared_memory_acquire();
 //Releases the shared memory, unlocking it.
 bool shared_memory_release(shared_memory_t* mem);
 
-//Closes shared memory
+//Maps the physical regions used to stream sequences, once for the whole process.
+//Regions holding areas of the DDR layout are mapped as far as the areas go.
+//With populate, the page tables are built upfront instead of faulting during the first sequence.
+bool shared_memory_map_regions(bool populate);
+
+//Virtual address of the span bytes at the physical address, inside an already mapped region.
+//Returns NULL if the region isn't mapped or doesn't hold the whole span.
+void* shared_memory_view(region_id_t id, uint32_t address, uint32_t span);
+
+//Closes shared memory, unmapping the regions as well
 bool shared_memory_close();
 
 //read property
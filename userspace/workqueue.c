@@ -16,6 +16,15 @@ typedef struct {
 	workitem_t* last;
 } workqueue_t;
 
+//a worker waited for by workqueue_run()
+typedef struct {
+	worker_f worker;
+	void* data;
+	bool done;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} sync_work_t;
+
 //--
 
 static workqueue_t queue;
@@ -210,4 +219,41 @@ bool workqueue_submit(worker_f worker, void* data, cleanup_f cleanup) {
 	log_debug("submitted new worker");
 	pthread_cond_signal(&not_empty_condition);
 	return true;
+}
+
+//--
+
+static void sync_worker(void* data) {
+	sync_work_t* work = (sync_work_t*)data;
+	work->worker(work->data);
+}
+
+//called after execution, or on shutdown
+static void sync_done(void* data) {
+	sync_work_t* work = (sync_work_t*)data;
+	pthread_mutex_lock(&work->mutex);
+	work->done = true;
+	pthread_cond_signal(&work->cond);
+	pthread_mutex_unlock(&work->mutex);
+}
+
+bool workqueue_run(worker_f worker, void* data) {
+	sync_work_t work = {
+		.worker = worker,
+		.data = data,
+		.done = false,
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+
+	if (!workqueue_submit(sync_worker, &work, sync_done)) {
+		return false;
+	}
+
+	pthread_mutex_lock(&work.mutex);
+	while (!work.done) {
+		pthread_cond_wait(&work.cond, &work.mutex);
+	}
+	pthread_mutex_unlock(&work.mutex);
+	return true;
 }
\ No newline at end of file
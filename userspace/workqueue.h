@@ -28,5 +28,9 @@ bool workqueue_stop();
 //Submit a new worker. The data & cleanup function can be NULL if the worker doesn't need any data.
 bool workqueue_submit(worker_f worker, void* data, cleanup_f cleanup);
 
+//Submit a worker and wait until it ran, after the workers submitted before it.
+//The data stays owned by the caller.
+bool workqueue_run(worker_f worker, void* data);
+
 #endif
 